@@ -0,0 +1,50 @@
+"""
+Compare the packed, tiled and square layouts of the distances (see: MatrixLayout).
+
+Tiles gather the distances among nearby indices, so they pay off when the order of the points follows
+their geometry. The points are clustered once in random order and once sorted along a space-filling
+(Morton) curve. The square layout reads every row contiguously whatever the order, at twice the memory.
+
+Usage: python benchmarks/bench_layout.py [n ...]
+"""
+import sys
+import time
+import numpy as np
+from scipy.spatial.distance import pdist
+from pyprotoclust import protoclust
+
+
+def morton_order(X, bits=10):
+    # Interleave the bits of the quantized coordinates
+    Q = ((X - X.min(axis=0)) / np.ptp(X, axis=0).clip(1e-12) * (2**bits - 1)).astype(np.int64)
+    keys = np.zeros(len(X), dtype=np.int64)
+    for b in range(bits):
+        for d in range(X.shape[1]):
+            keys |= ((Q[:, d] >> b) & 1) << (b * X.shape[1] + d)
+    return np.argsort(keys, kind='stable')
+
+
+def best_time(condensed, repeat=3, **kwargs):
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        protoclust(condensed, seed=0, **kwargs)
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def main(sizes):
+    rng = np.random.default_rng(0)
+    layouts = ['packed', 'tiled', 'square']
+    print(('{:>6} {:>8} {:>13}' + ' {:>8}' * len(layouts)).format('n', 'order', 'engine', *layouts))
+    for n in sizes:
+        X = rng.normal(size=(n, 3))
+        for order, points in [('random', X), ('morton', X[morton_order(X)])]:
+            condensed = pdist(points).astype(np.float32)
+            for engine in ['eccentricity', 'all_pairs']:
+                times = [best_time(condensed, engine=engine, layout=layout) for layout in layouts]
+                print(('{:>6} {:>8} {:>13}' + ' {:>8.3f}' * len(layouts)).format(n, order, engine, *times))
+
+
+if __name__ == '__main__':
+    main([int(a) for a in sys.argv[1:]] or [2000, 5000])
@@ -14,7 +14,6 @@ from distutils.core import Extension
 # OSX_LINK_ARGS = '-Wl,-rpath,/usr/local/opt/gcc@9/lib/gcc/9/'
 # ======
 
-# TODO: It would be nice to automatically check for OPENMP support
 try:
     from Cython.Build import cythonize
 except ImportError:
@@ -35,6 +34,13 @@ sources = [py_src + 'c_protoclust' + src_ext,
            cpp_src + 'protoclust.cpp',
            cpp_src + 'linkage.cpp',
            cpp_src + 'chain.cpp',
+           cpp_src + 'indexset.cpp',
+           cpp_src + 'kernels.cpp',
+           cpp_src + 'threadpool.cpp',
+           cpp_src + 'mappedfile.cpp',
+           cpp_src + 'pointdistances.cpp',
+           cpp_src + 'featurevectors.cpp',
+           cpp_src + 'bitvectors.cpp',
            cpp_src + 'ltmatrix.cpp']
 
 # In either case, source original (non-python) h/cpp to compile correctly.
@@ -42,8 +48,8 @@ e3 = Extension(name='pyprotoclust.c_protoclust',
                language = 'c++',
                sources=sources,
                include_dirs=[cpp_h],
-               extra_compile_args=['-fopenmp'],
-               extra_link_args=['-fopenmp'] #, OSX_LINK_ARGS]
+               extra_compile_args=['-pthread'],
+               extra_link_args=['-pthread'] #, OSX_LINK_ARGS]
                )
 
 extensions = [e3]
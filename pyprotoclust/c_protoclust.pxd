@@ -1,18 +1,90 @@
+from libcpp cimport bool
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+
 cdef extern from "protoclust.h":
     pass
 
+cdef extern from "kernels.h" namespace "minimax::kernels":
+    const char* get_isa()
+    bool set_isa(const char* name)
+
+cdef extern from "linkage.h" namespace "minimax":
+    cdef enum LinkageEngine "minimax::LinkageEngine":
+        all_pairs "minimax::LinkageEngine::all_pairs"
+        eccentricity "minimax::LinkageEngine::eccentricity"
+
+cdef extern from "ltmatrix.h" namespace "minimax":
+    cdef enum MatrixLayout "minimax::MatrixLayout":
+        packed "minimax::MatrixLayout::packed"
+        tiled "minimax::MatrixLayout::tiled"
+        square "minimax::MatrixLayout::square"
+
+cdef extern from "featurevectors.h" namespace "minimax":
+    cdef enum FeatureMetric "minimax::FeatureMetric":
+        euclidean "minimax::FeatureMetric::euclidean"
+        cosine "minimax::FeatureMetric::cosine"
+        manhattan "minimax::FeatureMetric::manhattan"
+
+cdef extern from "bitvectors.h" namespace "minimax":
+    cdef enum BitMetric "minimax::BitMetric":
+        hamming "minimax::BitMetric::hamming"
+        tanimoto "minimax::BitMetric::tanimoto"
+
+cdef extern from "pointdistances.h" namespace "minimax":
+    cdef enum DistanceType "minimax::DistanceType":
+        float32 "minimax::DistanceType::float32"
+        float16 "minimax::DistanceType::float16"
+        bfloat16 "minimax::DistanceType::bfloat16"
+        uint16 "minimax::DistanceType::uint16"
+        uint8 "minimax::DistanceType::uint8"
+
+    cdef struct Quantization:
+        DistanceType type
+        float scale
+        float offset
+
 cdef extern from "protoclust.h" namespace "minimax":
+    ctypedef bool (*ProgressCallback)(void* data, int merges) noexcept
+
     cdef cppclass Protoclust:
         Protoclust() except +
         Protoclust(int) except +
+        Protoclust(int, LinkageEngine) except +
+        Protoclust(int, LinkageEngine, MatrixLayout) except +
+        Protoclust(int, LinkageEngine, MatrixLayout, const string&) except +
+        Protoclust(int, LinkageEngine, MatrixLayout, const string&, Quantization) except +
+        Protoclust(const float*, int, int, FeatureMetric, LinkageEngine, MatrixLayout, const string&) except +
+        Protoclust(const unsigned char*, int, int, BitMetric, LinkageEngine, MatrixLayout, const string&) except +
+        Protoclust(const string&, size_t, int, LinkageEngine, const string&) except +
         
-        void set_distance(int i, int j, double distance) nogil
+        void set_distance(int i, int j, double distance) except + nogil
+        void set_condensed_distances(const float* condensed) except + nogil
+        void set_condensed_distances(const double* condensed) except + nogil
+        void set_feature_distances(const float* features, int dim, FeatureMetric metric) except + nogil
+        void set_num_threads(int num_threads)
+        void set_seed(unsigned int seed)
+        void set_lazy(bool lazy)
+        void set_metric(bool metric)
+        void set_max_radius(double radius)
+        void set_min_clusters(int clusters)
 
-        void compute()
-        void compute_index(int i)
+        void compute() except + nogil
+        bool compute(ProgressCallback callback, void* data, int interval) except + nogil
+        void compute_index(int i) except + nogil
+        void cut(const double* thresholds, int n_thresholds, int* labels,
+                 vector[vector[int]]& prototypes) except + nogil
 
         int get_Z_0(int i)
         int get_Z_1(int i)
         double get_Z_2(int i)
         int get_Z_3(int i)
-        int get_cluster_center(int i)
\ No newline at end of file
+        int get_cluster_center(int i)
+        int get_n_merges()
+        int get_n_elems()
+        int get_n_clusters()
+        int get_label(int i)
+        int get_prototype(int c)
+        long long get_chain_steps()
+        long long get_lazy_evaluations()
+        long long get_rounds()
\ No newline at end of file
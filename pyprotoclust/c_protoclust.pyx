@@ -1,13 +1,161 @@
 # distutils: language = c++
 
-from pyprotoclust.c_protoclust cimport Protoclust
+import array
+import os
+from cpython.exc cimport PyErr_CheckSignals
+from cython.view cimport array as cvarray
+from libcpp cimport bool
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+from pyprotoclust.c_protoclust cimport Protoclust, LinkageEngine, all_pairs, eccentricity
+from pyprotoclust.c_protoclust cimport get_isa, set_isa
+
+ctypedef fused real:
+    float
+    double
+
+def simd_isa():
+    """
+    The instruction set used by the linkage kernels: 'avx512', 'avx2' or 'scalar'.
+    """
+    return get_isa().decode('ascii')
+
+
+def set_simd_isa(name):
+    """
+    Select the instruction set used by the linkage kernels. The widest one supported by the host is selected on import.
+
+    Args:
+        name (str): 'avx512', 'avx2', 'scalar' or 'native' (the widest supported).
+    """
+    if not set_isa(name.encode('ascii')):
+        raise ValueError("Instruction set '{}' is not supported on this host.".format(name))
+
+
+cdef class _Progress:
+    """
+    State shared with report_progress while the clustering runs without the GIL.
+    """
+    cdef object callback
+    cdef object error
+
+    def __cinit__(self, callback):
+        self.callback = callback
+        self.error = None
+
+
+cdef bool report_progress(void* data, int merges) noexcept with gil:
+    # Honor KeyboardInterrupt and forward the report; any exception stops the clustering
+    cdef _Progress progress = <_Progress> data
+    try:
+        PyErr_CheckSignals()
+        if progress.callback is not None:
+            progress.callback(merges)
+    except BaseException as e:
+        progress.error = e
+        return False
+    return True
+
+
+cdef FeatureMetric feature_metric_type(name) except *:
+    if name == 'euclidean':
+        return euclidean
+    elif name == 'cosine':
+        return cosine
+    elif name == 'manhattan':
+        return manhattan
+    raise ValueError("Unknown feature metric '{}'. Expected 'euclidean', 'cosine' or 'manhattan'.".format(name))
+
+
+cdef BitMetric bit_metric_type(name) except *:
+    if name == 'hamming':
+        return hamming
+    elif name == 'tanimoto':
+        return tanimoto
+    raise ValueError("Unknown bit metric '{}'. Expected 'hamming' or 'tanimoto'.".format(name))
+
 
 # Create a Cython extension type which holds a C++ instance as an attribute and create a bunch of forwarding methods
 cdef class CyProtoclust:
     cdef Protoclust c_protoclust  # Hold a C++ instance which we're wrapping
 
-    def __cinit__(self, int n):
-        self.c_protoclust = Protoclust(n)
+    def __cinit__(self, int n, engine='all_pairs', int n_threads=0, seed=None, bint lazy=False,
+                  bint metric=False, layout='packed', mmap_dir=None, dtype='float32', quantization=None,
+                  const float[:, ::1] features=None, feature_metric='euclidean',
+                  const unsigned char[:, ::1] bits=None, mmap_file=None, size_t mmap_offset=0, max_radius=None,
+                  int min_clusters=1):
+        cdef LinkageEngine c_engine
+        cdef MatrixLayout c_layout
+        if engine == 'eccentricity':
+            c_engine = eccentricity
+        elif engine == 'all_pairs':
+            c_engine = all_pairs
+        else:
+            raise ValueError("Unknown linkage engine '{}'. Expected 'eccentricity' or 'all_pairs'.".format(engine))
+        if layout == 'packed':
+            c_layout = packed
+        elif layout == 'tiled':
+            c_layout = tiled
+        elif layout == 'square':
+            c_layout = square
+        else:
+            raise ValueError("Unknown matrix layout '{}'. Expected 'packed', 'tiled' or 'square'.".format(layout))
+        cdef Quantization c_quantization
+        if dtype == 'float32':
+            c_quantization.type = float32
+        elif dtype == 'float16':
+            c_quantization.type = float16
+        elif dtype == 'bfloat16':
+            c_quantization.type = bfloat16
+        elif dtype == 'uint16':
+            c_quantization.type = uint16
+        elif dtype == 'uint8':
+            c_quantization.type = uint8
+        else:
+            raise ValueError("Unknown distance type '{}'. Expected 'float32', 'float16', 'bfloat16', 'uint16' or "
+                             "'uint8'.".format(dtype))
+        if quantization is not None:
+            c_quantization.scale, c_quantization.offset = quantization
+            if not c_quantization.scale > 0:
+                raise ValueError('The quantization scale must be positive, got {}.'.format(c_quantization.scale))
+        # An empty directory keeps the distance matrices in memory
+        cdef string c_directory = os.fsencode(mmap_dir) if mmap_dir else b''
+        cdef FeatureMetric c_metric
+        cdef BitMetric c_bit_metric
+        cdef string c_path
+        # The features and the bits are copied, so the arrays need not outlive this object. A condensed float32 file
+        # is mapped read-only as the distance matrix (in condensed order, whatever the layout)
+        if mmap_file is not None:
+            if dtype != 'float32':
+                raise ValueError('Mapped distances are float32, got dtype {}.'.format(dtype))
+            c_path = os.fsencode(mmap_file)
+            self.c_protoclust = Protoclust(c_path, mmap_offset, n, c_engine, c_directory)
+        elif features is None and bits is None:
+            self.c_protoclust = Protoclust(n, c_engine, c_layout, c_directory, c_quantization)
+        elif features is not None:
+            c_metric = feature_metric_type(feature_metric)
+            if features.shape[0] != n:
+                raise ValueError('Expected {} rows of features, got {}.'.format(n, features.shape[0]))
+            if dtype != 'float32':
+                raise ValueError('Distances computed from features are float32, got dtype {}.'.format(dtype))
+            self.c_protoclust = Protoclust(&features[0, 0] if n > 0 and features.shape[1] > 0 else NULL, n,
+                                           features.shape[1], c_metric, c_engine, c_layout, c_directory)
+        else:
+            c_bit_metric = bit_metric_type(feature_metric)
+            if bits.shape[0] != n:
+                raise ValueError('Expected {} rows of bits, got {}.'.format(n, bits.shape[0]))
+            if dtype != 'float32':
+                raise ValueError('Distances computed from bits are float32, got dtype {}.'.format(dtype))
+            self.c_protoclust = Protoclust(&bits[0, 0] if n > 0 and bits.shape[1] > 0 else NULL, n,
+                                           bits.shape[1], c_bit_metric, c_engine, c_layout, c_directory)
+        self.c_protoclust.set_num_threads(n_threads)
+        if seed is not None:
+            self.c_protoclust.set_seed(seed)
+        self.c_protoclust.set_lazy(lazy)
+        self.c_protoclust.set_metric(metric)
+        if max_radius is not None:
+            self.c_protoclust.set_max_radius(max_radius)
+        self.c_protoclust.set_min_clusters(min_clusters)
 
     def initialize_distances(self, double[:,:] init_distances):
         """
@@ -16,16 +164,64 @@ cdef class CyProtoclust:
         Args:
             init_distances (double[:,:]): A distance matrix.
         """
-        n = len(init_distances)
-        for i in range(n):
-            for j in range(i): # Defaults to 0 (so skip diagonals)
-                self.c_protoclust.set_distance(i,j,init_distances[i,j])
+        cdef int n = len(init_distances)
+        cdef int i, j
+        with nogil:
+            for i in range(n):
+                for j in range(i): # Defaults to 0 (so skip diagonals)
+                    self.c_protoclust.set_distance(i,j,init_distances[i,j])
+
+    def initialize_condensed(self, const real[::1] condensed):
+        """
+        Initialize the distance matrix in the cpp code from a condensed distance vector in a single pass, without
+        forming the square matrix.
+
+        Args:
+            condensed (float[::1] or double[::1]): A condensed distance vector of length n*(n-1)/2, ordered as the
+                output of scipy.spatial.distance.pdist.
+        """
+        if condensed.shape[0] > 0:
+            with nogil:
+                self.c_protoclust.set_condensed_distances(&condensed[0])
+
+    def initialize_features(self, const float[:, ::1] features, feature_metric='euclidean'):
+        """
+        Initialize the distance matrix in the cpp code with the distances between the rows of features, computed
+        natively in parallel tiles without forming the matrix in Python.
+
+        Args:
+            features (float[:, ::1]): An n by d C-contiguous float32 array of feature vectors.
+            feature_metric (str): Optional. 'euclidean', 'cosine' or 'manhattan'. Default 'euclidean'.
+        """
+        cdef FeatureMetric c_metric = feature_metric_type(feature_metric)
+        cdef int dim = features.shape[1]
+        if features.shape[0] > 0 and dim > 0:
+            with nogil:
+                self.c_protoclust.set_feature_distances(&features[0, 0], dim, c_metric)
 
-    def compute(self):
+    def compute(self, callback=None, interval=None):
         """
-        Compute all of the linkages of the distance matrix.
+        Compute all of the linkages of the distance matrix in C++ with the GIL released.
+
+        Args:
+            callback (callable): Optional. Called with the number of completed merges every interval merges and after
+                the last merge. An exception raised by the callback stops the clustering and is re-raised here.
+            interval (int): Optional. Number of merges between calls to callback, which also check for
+                KeyboardInterrupt. Default None: about a hundred calls with a callback, and none at all (nor checks)
+                without one.
         """
-        self.c_protoclust.compute()
+        cdef _Progress progress = _Progress(callback)
+        cdef ProgressCallback c_callback = report_progress
+        cdef bool completed
+        if interval is None:
+            interval = max(1, (self.c_protoclust.get_n_elems() - 1) // 100)
+            if callback is None:
+                c_callback = NULL
+        cdef int c_interval = interval
+        with nogil:
+            completed = self.c_protoclust.compute(c_callback, <void*> progress, c_interval)
+        if not completed:
+            raise progress.error
     
     def compute_at(self, int i):
         """
@@ -35,17 +231,44 @@ cdef class CyProtoclust:
         Args:
             i (int): The index of the current active linkage.
         """
-        self.c_protoclust.compute_index(i)
+        with nogil:
+            self.c_protoclust.compute_index(i)
+
+    def cut(self, int n, thresholds):
+        """
+        Cut the clustering at every threshold in one pass over the merges, as scipy.cluster.hierarchy.fcluster with
+        criterion='distance' does at each one. Call after compute.
+
+        Args:
+            n (int): The size of the original distance matrix.
+            thresholds (sequence of float): The heights to cut at, at least one.
+
+        Returns:
+            (tuple): tuple containing:
+
+                - labels: An n by len(thresholds) int32 buffer (e.g. for numpy.asarray) of the cluster of each point
+                  at each threshold, numbered from 0 by first point.
+                - prototypes: For each threshold, the prototype of each cluster by label.
+        """
+        cdef double[::1] c_thresholds = array.array('d', thresholds)
+        cdef int n_thresholds = c_thresholds.shape[0]
+        if n < 1 or n_thresholds < 1:
+            raise ValueError('Expected at least one point and one threshold, got {} and {}.'.format(n, n_thresholds))
+        cdef int[:, ::1] labels = cvarray(shape=(n, n_thresholds), itemsize=sizeof(int), format='i')
+        cdef vector[vector[int]] prototypes
+        with nogil:
+            self.c_protoclust.cut(&c_thresholds[0], n_thresholds, &labels[0, 0], prototypes)
+        return labels.base, prototypes
 
     def Z(self, int n):
         """
-        Access the linkage matrix.
+        Access the linkage matrix, truncated if compute stopped early (see: max_radius and min_clusters).
         """
         return [[self.c_protoclust.get_Z_0(i),
                  self.c_protoclust.get_Z_1(i),
                  self.c_protoclust.get_Z_2(i),
                  self.c_protoclust.get_Z_3(i)]
-                for i in range(n-1)]
+                for i in range(min(n-1, self.c_protoclust.get_n_merges()))]
 
     def center(self, int i):
         """
@@ -63,5 +286,38 @@ cdef class CyProtoclust:
         Args:
             n (int): The size of the original distance matrix.
         """
-        return [self.center(i) for i in range(2*n-1)]
-            
\ No newline at end of file
+        return [self.center(i) for i in range(n + min(n-1, self.c_protoclust.get_n_merges()))]
+
+    def labels(self):
+        """
+        Access the label of each point, numbering the clusters that remain after compute by their first point.
+        """
+        cdef int k = self.c_protoclust.get_n_clusters()
+        # Every point is labelled once compute is done (a merge leaves one cluster less)
+        return [self.c_protoclust.get_label(i) for i in range(self.c_protoclust.get_n_merges() + k if k > 0 else 0)]
+
+    def prototypes(self):
+        """
+        Access the prototype of each cluster that remains after compute, by label.
+        """
+        return [self.c_protoclust.get_prototype(c) for c in range(self.c_protoclust.get_n_clusters())]
+            
+    def chain_steps(self):
+        """
+        Number of nearest-neighbor lookups made while growing chains, about 2 per merge when the
+        chains stay short.
+        """
+        return self.c_protoclust.get_chain_steps()
+
+
+    def rounds(self):
+        """
+        Number of rounds of merges made so far, each merging every recurrent pair found (see: compute).
+        """
+        return self.c_protoclust.get_rounds()
+
+    def lazy_evaluations(self):
+        """
+        Number of linkages evaluated on demand when constructed with lazy=True.
+        """
+        return self.c_protoclust.get_lazy_evaluations()
\ No newline at end of file
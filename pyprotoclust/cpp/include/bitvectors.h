@@ -0,0 +1,52 @@
+#ifndef BITVECTORS_H
+#define BITVECTORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace minimax {
+
+    /**
+     *  Distance between two bit vectors a and b (e.g. binary fingerprints).
+     *
+     *  hamming:    The number of bits that differ, |a ^ b|.
+     *  tanimoto:   1 - |a & b| / |a | b| (the Jaccard distance), 0 between two empty vectors.
+     **/
+    enum class BitMetric { hamming, tanimoto };
+
+    /**
+     *  Points given by bit vectors packed into 64-bit words, whose distances are computed on demand
+     *  with popcounts (see: kernels::popcount_xor) instead of being stored, as FeatureVectors.
+     *
+     *  The counts are exact and symmetric, so every distance is the same whichever point comes first.
+     **/
+    class BitVectors {
+        public:
+            // Rows are padded with zero words to a multiple of this many words (512 bits)
+            static constexpr std::size_t alignment = 8;
+
+            BitVectors() {};
+            /**
+             *  Copy the n rows of bytes bytes in the row-major array data. Only the counts of set bits
+             *  matter, so any consistent packing of the bits into bytes (or one bit per byte) will do.
+             **/
+            BitVectors(const std::uint8_t* data, std::size_t n, std::size_t bytes, BitMetric metric);
+
+            float get(std::size_t i, std::size_t j) const;
+
+            const std::uint64_t* row(std::size_t i) const { return this->values.data() + i*this->stride; };
+            std::size_t size() const { return this->s; };
+            BitMetric metric() const { return this->m; };
+
+        private:
+            std::vector<std::uint64_t> values;  // n rows, stride apart
+            std::vector<std::size_t> counts;    // Bits set in each row (tanimoto only)
+            std::size_t s = 0;
+            std::size_t stride = 0;             // Words per row
+            BitMetric m = BitMetric::hamming;
+    };
+
+}
+
+#endif
@@ -1,21 +1,35 @@
 #ifndef CHAIN_H
 #define CHAIN_H
 
+#include "indexset.h"
 #include "ltmatrix.h"
+#include <cstdint>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <random>
+#include <utility>
 #include <vector>
 
 namespace minimax {
 
     class Chain {
         public:
+            // Exact distance between the clusters in two slots (see: set_evaluator)
+            typedef std::function<float(int, int)> Evaluator;
+
             // Default does no inits
             Chain () {};
 
             // Size is constrained by RAND_MAX and INT_MAX
-            Chain(std::shared_ptr<LTMatrix<float> > dm);
+            Chain(std::shared_ptr<LTMatrix<float> > cluster_distance_matrix);
+
+            /**
+             *  Seed the choice of the slot that starts each chain (seeded from std::random_device
+             *  otherwise). With equal distances resolved by slot (see: nearest), a seed fixes the
+             *  whole clustering for a given distance matrix.
+             **/
+            void set_seed(unsigned int seed) { this->generator.seed(seed); };
 
             /** 
              *  Iterate over available indices from the current chain to find the next pair of recurrent nearest neighbors
@@ -23,29 +37,69 @@ namespace minimax {
             void grow_chain();
 
             /**
-             *  Remove the last two elements of the chain
+             *  List up to max_pairs recurrent pairs of nearest neighbors after growing the chain: the
+             *  end of the chain first, then the other mutual nearest neighbors among the available
+             *  slots. The pairs are disjoint and each is a valid next merge. Pairs farther apart than
+             *  ceiling are left out, and none are listed if the end of the chain is (see: retire_chain).
+             * 
+             *  The sweep rescans the slots whose nearest neighbor is unknown (see: nearest) up to
+             *  rescans_per_pair times the number of pairs listed so far, so that its cost stays in
+             *  proportion to the merges of the round; the others wait for a later sweep.
              **/
-            void trim_chain();
+            void recurrent_pairs(std::vector<std::pair<int, int> >& pairs, std::size_t max_pairs,
+                                 std::size_t rescans_per_pair, float ceiling = std::numeric_limits<float>::infinity());
 
             /**
-             *  Using the current chain, update the available indicies for iteration.
-             * 
-             *  TODO: Refactor iteration -> new index
+             *  Remove the slots of the chain from the available slots, without merging them. Each link
+             *  of the chain is at least as far as its end, and a merge never brings a cluster closer
+             *  than the nearer of its parts, so after the chain ends at a pair farther apart than
+             *  the ceiling no slot of the chain merges within it.
+             **/
+            void retire_chain();
+
+            /**
+             *  Using the current chain, update the available indicies for iteration and the cached
+             *  nearest neighbors, and cut the chain before the first merged slot. Expects the
+             *  distances (or bounds) to the merged slots to be set already.
              * 
              *  Parameters:
-             *      int r1: remove from available indices
-             *      int r2: remove from available indices
-             *      int iteration:  new available index = iteration + number of original indices
+             *      pairs: slots to remove from available indices, one pair per merge
+             *      merged: slot holding each merged cluster (recycled from its pair)
+             **/
+            void merge_indicies(const std::vector<std::pair<int, int> >& pairs, const std::vector<int>& merged);
+
+            /**
+             *  Evaluate distances lazily: distances recorded with set_bound are only lower bounds,
+             *  and the evaluator computes the exact distance when a bound could beat a nearest
+             *  neighbor. Must be set again whenever the evaluator's captures move.
              **/
-            void merge_indicies(int r1, int r2, int iteration);
+            void set_evaluator(Evaluator evaluator);
+
+            // Record a lower bound of the (pending) distance between slots i and j
+            void set_bound(int i, int j, float bound);
+
+            /**
+             *  Upper bounds of the pending distances, by slot. Nearest neighbor searches skip every
+             *  pending distance whose lower bound exceeds the least upper bound.
+             **/
+            void set_upper_bounds(std::shared_ptr<LTMatrix<float> > upper) { this->upper = upper; };
 
             // Access the recurrent nearest neighbors after growing the chain
             bool can_grow() { return this->available_indicies.size() > 1; };
             int chain_end_1() { return this->chain.empty() ? -1 : this->chain.back(); };
             int chain_end_2() { return this->chain.size() < 2 ? -1 : this->chain[this->chain.size()-2]; };
 
+            // Nearest-neighbor lookups made by grow_chain so far (about 2 per merge for short chains)
+            long long get_steps() { return this->steps; };
+
+            // Pending distances evaluated exactly so far (see: set_evaluator)
+            long long get_evaluations() { return this->evaluations; };
+
+            // Calls to recurrent_pairs so far, one per round of merges
+            long long get_rounds() { return this->rounds; };
+
             // Read-only access to available indices
-            const std::vector<int>& get_available_indicies() { return this->available_indicies; };
+            const std::vector<int>& get_available_indicies() { return this->available_indicies.get_values(); };
 
         private:
             int n_elems;
@@ -53,14 +107,56 @@ namespace minimax {
             std::default_random_engine generator;
 
             std::vector<int> chain;
+            long long steps;
+            long long evaluations;
+            long long rounds;
             
-            // Full distance matrix (n_elems initial points and n_elems-1 joins)
-            std::shared_ptr<LTMatrix<float> > full_distance_matrix;
+            // Distances between the clusters held in each slot (n_elems slots)
+            std::shared_ptr<LTMatrix<float> > cluster_distance_matrix;
+
+            // Available slots with O(1) removal (iteration order is not preserved)
+            IndexSet available_indicies;
+
+            /**
+             *  Cached nearest neighbor of each slot (-1 if unknown) and its distance. A cached
+             *  neighbor stays valid until it is merged or the merged cluster comes closer (see:
+             *  merge_indicies), so most chain steps avoid a scan over the available slots.
+             **/
+            std::vector<int> nn_index;
+            std::vector<float> nn_distance;
+
+            // One bit per distance, set while the distance is only a lower bound (lazy evaluation)
+            Evaluator evaluator;
+            std::vector<std::uint64_t> pending;
+            std::shared_ptr<LTMatrix<float> > upper;
+
+            static std::size_t offset(int i, int j) {
+                return i >= j ? LTMatrix<float>::offset(i, j) : LTMatrix<float>::offset(j, i);
+            };
+
+            bool is_pending(int i, int j) {
+                if (this->pending.empty())
+                    return false;
+                std::size_t k = offset(i, j);
+                return (this->pending[k / 64] >> (k % 64)) & 1;
+            };
 
-            std::vector<int> available_indicies;
+            // Evaluate a pending distance exactly and record it
+            float evaluate(int i, int j);
+
+            /**
+             *  Total order on the neighbors j of a fixed slot: by distance, then by slot. For a fixed
+             *  slot this is the order of the pairs by (distance, min slot, max slot), so every link
+             *  of a chain is strictly smaller than the one before it, even among equal distances.
+             **/
+            static bool closer(float d1, int j1, float d2, int j2) {
+                return d1 < d2 || (d1 == d2 && j1 < j2);
+            };
 
             /**
-             *  Return the nearest neighbor of index from the set of possible_neighbors using distance.
+             *  Return the nearest neighbor of index from the set of possible_neighbors using distance
+             *  (see: closer), independent of the iteration order. Pending distances are evaluated
+             *  only while their lower bound could still beat the nearest neighbor.
              **/
             int nearest(const int index);
             
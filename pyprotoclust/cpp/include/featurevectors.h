@@ -0,0 +1,65 @@
+#ifndef FEATUREVECTORS_H
+#define FEATUREVECTORS_H
+
+#include <cstddef>
+#include <vector>
+
+namespace minimax {
+
+    /**
+     *  Distance between two feature vectors a and b.
+     *
+     *  euclidean:  sqrt(sum_k (a[k] - b[k])^2)
+     *  cosine:     1 - a.b / (|a| |b|), clamped to [0, 2]. A zero vector is at distance 1 from the others.
+     *  manhattan:  sum_k |a[k] - b[k]|
+     **/
+    enum class FeatureMetric { euclidean, cosine, manhattan };
+
+    /**
+     *  Points given by feature vectors, whose distances are computed on demand with the vectorized
+     *  kernels (see: kernels::squared_euclidean) instead of being stored. Reads cost O(dim) rather
+     *  than a load, for n*dim floats of memory rather than n*(n+1)/2.
+     *
+     *  Every distance is computed the same way whichever of the two points comes first, so repeated
+     *  reads agree bit for bit and the distance of a point to itself is 0.
+     **/
+    class FeatureVectors {
+        public:
+            // Rows are padded with zeros to a multiple of this many floats, which add nothing to any metric
+            static constexpr std::size_t alignment = 16;
+
+            FeatureVectors() {};
+            /**
+             *  Copy the n rows of dim floats in the row-major array data. With the cosine metric the
+             *  rows are scaled to unit norm here, so that a distance is one dot product.
+             **/
+            FeatureVectors(const float* data, std::size_t n, std::size_t dim, FeatureMetric metric);
+
+            float get(std::size_t i, std::size_t j) const;
+
+            /**
+             *  The distances between the rows i0 <= i < i1 and j0 <= j < j1, into
+             *  out[(i - i0)*ldo + (j - j0)], for a whole block at once. Euclidean and cosine distances
+             *  come from a block of dot products (see: kernels::dot_block), as |x|^2 + |y|^2 - 2 x.y for
+             *  the former; they may differ from get by rounding, most where |x - y| is far below |x|.
+             **/
+            void block(std::size_t i0, std::size_t i1, std::size_t j0, std::size_t j1, float* out,
+                       std::size_t ldo) const;
+
+            const float* row(std::size_t i) const { return this->values.data() + i*this->stride; };
+            std::size_t size() const { return this->s; };
+            std::size_t dim() const { return this->d; };
+            FeatureMetric metric() const { return this->m; };
+
+        private:
+            std::vector<float> values;      // n rows, stride apart
+            std::vector<float> norms;       // Squared norms of the rows (euclidean only)
+            std::size_t s = 0;
+            std::size_t d = 0;
+            std::size_t stride = 0;         // dim rounded up to the alignment
+            FeatureMetric m = FeatureMetric::euclidean;
+    };
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef INDEXSET_H
+#define INDEXSET_H
+
+#include <cstddef>
+#include <vector>
+
+namespace minimax {
+
+    /**
+     *  Set of indices in [0, capacity) stored densely for contiguous iteration.
+     * 
+     *  A position map locates each member in the dense vector so that removal swaps the last
+     *  member into the hole. Insertion and removal are O(1); iteration order is not preserved.
+     **/
+    class IndexSet {
+        public:
+            IndexSet() {};
+            IndexSet(int capacity);
+
+            // Add index (no-op if present)
+            void insert(int index);
+
+            // Remove index (no-op if absent)
+            void remove(int index);
+
+            bool contains(int index) const { return this->position[index] >= 0; };
+            std::size_t size() const { return this->values.size(); };
+            int operator[](std::size_t k) const { return this->values[k]; };
+
+            // Read-only access to the members, in no particular order
+            const std::vector<int>& get_values() const { return this->values; };
+
+        private:
+            std::vector<int> values;
+
+            // Position of each index in values, -1 if absent (length: capacity)
+            std::vector<int> position;
+    };
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace minimax {
+namespace kernels {
+
+    /**
+     *  Vectorized reductions for the linkage hot loops.
+     *
+     *  Each kernel has a scalar, an AVX2 and an AVX-512 version. The widest version supported by the
+     *  host is selected at load time (see: set_isa). Points are int indices into per-point vectors or
+     *  into a packed lower triangle (see: LTMatrix::offset), which the kernels gather directly.
+     *
+     *  Reductions that return a position report the first position reaching the result, so all
+     *  versions agree with a sequential scan.
+     **/
+
+    /**
+     *  min_t max(u[idx[t]], v[idx[t]]) for t < k.
+     *
+     *  Updates:
+     *      - position is set to the first t reaching the minimum (k if k == 0).
+     **/
+    float min_max_gather(const float* u, const float* v, const int* idx, std::size_t k, std::size_t& position);
+
+    /**
+     *  min_t max(u[idx[t]], lt(c, idx[t])) for t < k, where lt is a packed lower triangle.
+     *
+     *  Updates:
+     *      - position is set to the first t reaching the minimum (k if k == 0).
+     **/
+    float min_max_gather_lt(const float* u, const float* lt, int c, const int* idx, std::size_t k,
+                            std::size_t& position);
+
+    /**
+     *  max_t lt(c, idx[t]) for t < k, abandoned once the running max exceeds cutoff.
+     *
+     *  Returns the exact max if it is at most cutoff, otherwise some value above cutoff.
+     *
+     *  Updates:
+     *      - position is set to a t whose distance equals the returned value (k if k == 0).
+     **/
+    float max_gather_lt(const float* lt, int c, const int* idx, std::size_t k, float cutoff,
+                        std::size_t& position);
+
+    /**
+     *  max_t v[idx[t]] for t < k, abandoned once the running max exceeds cutoff. With v a row of a
+     *  square matrix this is max_gather_lt without the offset arithmetic (see: MatrixLayout).
+     *
+     *  Returns and updates as max_gather_lt.
+     **/
+    float max_gather(const float* v, const int* idx, std::size_t k, float cutoff, std::size_t& position);
+
+    /**
+     *  out[x] = max(u[x], lt(c, x)) for x < n, or out[x] = lt(c, x) if u is null. u may alias out.
+     **/
+    void max_row_lt(const float* u, const float* lt, int c, std::size_t n, float* out);
+
+    /**
+     *  out[x] = max(u[x], v[x]) for x < n. u or v may alias out.
+     **/
+    void max_elementwise(const float* u, const float* v, std::size_t n, float* out);
+
+    /**
+     *  Reductions over two feature vectors of dim floats (see: FeatureVectors): sum_k (a[k] - b[k])^2,
+     *  sum_k |a[k] - b[k]| and sum_k a[k] b[k]. Each version sums in a fixed order with terms that
+     *  are symmetric in a and b, so swapping a and b gives the same bits; versions may differ in
+     *  rounding.
+     **/
+    float squared_euclidean(const float* a, const float* b, std::size_t dim);
+    float manhattan(const float* a, const float* b, std::size_t dim);
+    float dot(const float* a, const float* b, std::size_t dim);
+
+    /**
+     *  Block of dot products between two sets of feature vectors, dim floats apart:
+     *  out[r*ldo + c] = dot(a + r*dim, b + c*dim, dim) for r < rows and c < cols. dim is a multiple
+     *  of 16 (see: FeatureVectors::stride). The products are register-blocked, so that each vector
+     *  load feeds several of them; they may differ from dot in rounding.
+     **/
+    void dot_block(const float* a, std::size_t rows, const float* b, std::size_t cols, std::size_t dim, float* out,
+                   std::size_t ldo);
+
+    /**
+     *  Bits set in a ^ b and in a & b, over two bit vectors of words 64-bit words (see: BitVectors).
+     *  The scalar version counts without a popcount instruction, the AVX2 version with POPCNT and the
+     *  AVX-512 version with VPOPCNTQ where the host has it.
+     **/
+    std::size_t popcount_xor(const std::uint64_t* a, const std::uint64_t* b, std::size_t words);
+    std::size_t popcount_and(const std::uint64_t* a, const std::uint64_t* b, std::size_t words);
+
+    /**
+     *  The kernels above over narrow codes (see: Quantization), instantiated for std::uint16_t and
+     *  std::uint8_t. The codes are widened to float inside the kernels, which is exact. u may be null
+     *  in max_elementwise too (out[x] = v[x]).
+     **/
+    template <class C>
+    float min_max_gather(const float* u, const C* v, const int* idx, std::size_t k, std::size_t& position);
+    template <class C>
+    float min_max_gather_lt(const float* u, const C* lt, int c, const int* idx, std::size_t k, std::size_t& position);
+    template <class C>
+    float max_gather_lt(const C* lt, int c, const int* idx, std::size_t k, float cutoff, std::size_t& position);
+    template <class C>
+    float max_gather(const C* v, const int* idx, std::size_t k, float cutoff, std::size_t& position);
+    template <class C>
+    void max_row_lt(const float* u, const C* lt, int c, std::size_t n, float* out);
+    template <class C>
+    void max_elementwise(const float* u, const C* v, std::size_t n, float* out);
+
+    /**
+     *  Kernels for the tiled triangle (see: MatrixLayout). Points are int indices as above.
+     **/
+
+    /** As max_gather_lt, for the tiled triangle. **/
+    float max_gather_tiled(const float* lt, int c, const int* idx, std::size_t k, float cutoff,
+                           std::size_t& position);
+
+    /** As min_max_gather_lt, for the tiled triangle. **/
+    float min_max_gather_tiled(const float* u, const float* lt, int c, const int* idx, std::size_t k,
+                               std::size_t& position);
+
+    /** As max_row_lt, for the tiled triangle. **/
+    void max_row_tiled(const float* u, const float* lt, int c, std::size_t n, float* out);
+
+    /**
+     *  Name of the instruction set in use: "avx512", "avx2" or "scalar".
+     **/
+    const char* get_isa();
+
+    /**
+     *  Select the kernels for the named instruction set ("avx512", "avx2", "scalar" or "native" for
+     *  the widest supported). Not thread-safe: call while no clustering is running.
+     *
+     *  Returns:
+     *      - false (and keeps the current kernels) if the host or the build does not support it.
+     **/
+    bool set_isa(const char* name);
+
+}
+}
+
+#endif
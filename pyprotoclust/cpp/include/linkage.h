@@ -2,15 +2,33 @@
 #define LINKAGE_H
 
 #include "ltmatrix.h"
+#include "pointdistances.h"
 #include <memory>
 #include <tuple>
 #include <vector>
 
 namespace minimax {
+
+    /**
+     *  Strategy used to evaluate the minimax linkage between two clusters.
+     * 
+     *  all_pairs:      Scan every pair of points in G+H, O(|G+H|^2) per linkage.
+     *  eccentricity:   Keep m_C[x] = max_{y in C} d(x, y) for each merged cluster C so that a
+     *                  linkage costs O(|G+H|) and a merge costs O(n). The n floats per live merged
+     *                  cluster reach n^2 / 2 floats when n / 2 pairs are merged first.
+     **/
+    enum class LinkageEngine { all_pairs, eccentricity };
+
     class Linkage {
         public:
             Linkage() {};
-            Linkage(std::shared_ptr<LTMatrix<float> > full_distance_matrix);
+            /**
+             *  With narrow distances (see: Quantization) the linkage works on the codes and decodes
+             *  the radii it returns; eccentricity vectors hold codes. With feature or bit vectors (see:
+             *  FeatureVectors, BitVectors) each distance is computed as it is read, and scans skip the
+             *  distances that cannot change their result.
+             **/
+            Linkage(const PointDistances& distance_matrix);
             
             /**
              * For each point in Gg+Hh, find the maximal radius at that point to
@@ -25,6 +43,44 @@ namespace minimax {
              **/
             std::tuple<double, int> minimax_linkage(const std::vector<int>& Gg, const std::vector<int>& Hh) const;
 
+            /**
+             * As above, with candidate centers of G+H (e.g. the prototypes of G and H) evaluated first.
+             * Their radius bounds the search: a candidate is abandoned as soon as its running max
+             * exceeds the best radius so far. The result is that of the exhaustive scan.
+             * 
+             * A negative center is ignored.
+             **/
+            std::tuple<double, int> minimax_linkage(const std::vector<int>& Gg, const std::vector<int>& Hh,
+                                                    int G_center, int H_center) const;
+
+            /**
+             * Minimax linkage of G+H from the eccentricity vectors of G and H. The radius at a
+             * point x is max(m_G[x], m_H[x]), so only the points of G+H are visited once.
+             * 
+             * An empty eccentricity vector marks a singleton cluster, whose eccentricities are
+             * read directly from the distance matrix.
+             * 
+             * Returns:
+             *      - A tuple containing the radius and center for the linkage
+             **/
+            std::tuple<double, int> minimax_linkage(const std::vector<int>& Gg, const std::vector<float>& mGg,
+                                                    const std::vector<int>& Hh, const std::vector<float>& mHh) const;
+
+            /**
+             * Fill mGH with the eccentricity vector of G+H, the elementwise max of the vectors of G and H.
+             * 
+             * Updates:
+             *      - mGH is resized to n_elems.
+             **/
+            void merge_eccentricity(const std::vector<int>& Gg, const std::vector<float>& mGg,
+                                    const std::vector<int>& Hh, const std::vector<float>& mHh,
+                                    std::vector<float>& mGH) const;
+
+            /** The max distance (code) from the point x to the cluster G (see: eccentricity minimax_linkage) **/
+            float eccentricity(const std::vector<int>& Gg, const std::vector<float>& mGg, int x) const {
+                return mGg.empty() ? this->distance_matrix.code(Gg[0], x) : mGg[x];
+            };
+
             /**
              *  Indirectly load G and H and indirectly return the radius and center.
              * 
@@ -50,7 +106,31 @@ namespace minimax {
             int get_minimax_center() { return this->center; };
 
         private:
-            std::shared_ptr<LTMatrix<float>> distance_matrix;
+            PointDistances distance_matrix;
+
+            /**
+             * The max distance from center to G+H, or any value above cutoff once it is known to
+             * exceed cutoff. The point that exceeded the cutoff is stored in witness and checked
+             * first by the next call.
+             **/
+            double bounded_radius(int center, const std::vector<int>& Gg, const std::vector<int>& Hh,
+                                  double cutoff, int& witness) const;
+
+            /**
+             * The min over x in members of max(m_G[x], m_H[x]), with position set to the first
+             * member reaching it.
+             **/
+            float min_eccentricity(const std::vector<int>& members,
+                                   const std::vector<int>& Gg, const std::vector<float>& mGg,
+                                   const std::vector<int>& Hh, const std::vector<float>& mHh,
+                                   std::size_t& position) const;
+
+            // min over x in members of max(u[x], d(c, x)), as min_eccentricity, for any layout and type
+            float min_max_row(const float* u, int c, const std::vector<int>& members, std::size_t& position) const;
+
+            // out[x] = max(u[x], d(c, x)) for every point x, or d(c, x) if u is null; u may alias out
+            void max_row(const float* u, int c, float* out) const;
+
             std::vector<int> G;
             std::vector<int> H;
 
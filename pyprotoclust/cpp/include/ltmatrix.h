@@ -1,26 +1,110 @@
 #ifndef LTMATRIX_H
 #define LTMATRIX_H
 
+#include "mappedfile.h"
+#include <cstddef>
+#include <memory>
 #include <vector>
 
 namespace minimax {
+
+    /**
+     *  Storage order of an LTMatrix.
+     * 
+     *  packed: Rows of the triangle one after the other (see: offset).
+     *  tiled:  Square tiles of tile_size x tile_size entries, stored row by row within each tile and
+     *          in packed order between tiles (see: tiled_offset). The distances among a set of points
+     *          then lie in few tiles, so gathers over a cluster stay within a few pages.
+     *  square: The full symmetric n x n matrix, row by row; set writes both halves. Every row is
+     *          contiguous (see: row), so scans over j of (i, j) stream instead of walking a column
+     *          of the triangle, at twice the memory.
+     *  condensed: The upper triangle row by row without the diagonal, the order of
+     *          scipy.spatial.distance.pdist (see: condensed_offset). Stores a precomputed condensed
+     *          vector as is, e.g. a file mapped without loading. The diagonal reads as 0 and is not set.
+     **/
+    enum class MatrixLayout { packed, tiled, square, condensed };
+
     // Lower-triangular matrix class
     template <class T>
     class LTMatrix {
         public:
-            LTMatrix() { this->s = 0; };
-            LTMatrix(int n);
+            LTMatrix() { this->s = 0; this->l = MatrixLayout::packed; this->values = nullptr; };
+            LTMatrix(std::size_t n, MatrixLayout layout = MatrixLayout::packed);
+
+            /**
+             *  Entries stored in a mapped file of at least entries(n, layout) values instead of memory.
+             *  A read-only mapping (see: MappedFile::open) must not be set (see: read_only).
+             **/
+            LTMatrix(std::size_t n, MatrixLayout layout, std::shared_ptr<MappedFile> file);
+
+            // A copy holds its entries in memory, whatever the storage of other
+            LTMatrix(const LTMatrix<T>& other);
+            LTMatrix<T>& operator=(const LTMatrix<T>& other);
+            LTMatrix(LTMatrix<T>&& other) = default;
+            LTMatrix<T>& operator=(LTMatrix<T>&& other) = default;
 
-            T& operator()(int i, int j);
+            // Copy the entries of other, of the same size and layout, into the current storage
+            void copy_from(const LTMatrix<T>& other);
 
-            T get(int i, int j) const;
-            void set(int i, int j, T dij);
+            /**
+             *  With square storage a write through the reference updates (i, j) only: write with set.
+             *  Not defined on the diagonal of condensed storage.
+             **/
+            T& operator()(std::size_t i, std::size_t j);
+
+            T get(std::size_t i, std::size_t j) const;
+            void set(std::size_t i, std::size_t j, T dij);
 
             // Return the size of (i,j < size)
-            int size() { return this->s; };
+            std::size_t size() const { return this->s; };
+
+            MatrixLayout layout() const { return this->l; };
+
+            // Whether the entries are mapped from a file read-only
+            bool read_only() const { return this->file && !this->file->writable(); };
+
+            // Storage for kernels that compute their own offsets (see: offset, tiled_offset)
+            const T* data() const { return this->values; };
+
+            // Row i of square storage: entry j is (i, j)
+            const T* row(std::size_t i) const { return this->values + i*this->s; };
+
+            // Number of entries stored for size n
+            static std::size_t entries(std::size_t n, MatrixLayout layout);
+
+            // Pass the expected access on to a mapped file (see: MappedFile::advise); no-op in memory
+            void advise(Access access) { if (this->file) this->file->advise(access); };
+
+            // Position of (i, j <= i) in the packed storage
+            static std::size_t offset(std::size_t i, std::size_t j) { return i*(i+1)/2 + j; };
+
+            // Position of (i, j <= i) in the tiled storage: 32 x 32 tiles of 4 KiB floats, a page
+            static constexpr std::size_t tile_shift = 5;
+            static constexpr std::size_t tile_size = std::size_t(1) << tile_shift;
+            static std::size_t tiled_offset(std::size_t i, std::size_t j) {
+                const std::size_t mask = tile_size - 1;
+                return (offset(i >> tile_shift, j >> tile_shift) << (2*tile_shift)) +
+                       ((i & mask) << tile_shift) + (j & mask);
+            };
+
+            // Position of (j < i) in condensed storage of size n
+            static std::size_t condensed_offset(std::size_t n, std::size_t i, std::size_t j) {
+                return n*j - j*(j+1)/2 + (i-j-1);
+            };
         
         private:
-            int s;
+            std::size_t s;
+            MatrixLayout l;
+
+            // Position of (i, j <= i) in this->distance
+            std::size_t index(std::size_t i, std::size_t j) const {
+                switch (this->l) {
+                    case MatrixLayout::tiled: return tiled_offset(i, j);
+                    case MatrixLayout::square: return i*this->s + j;
+                    case MatrixLayout::condensed: return condensed_offset(this->s, i, j);
+                    default: return offset(i, j);
+                }
+            };
 
             /**
              * Lower triangular coordinates are given such that j<=i.
@@ -38,8 +122,14 @@ namespace minimax {
              *  | ...   ^^         ...|
              * 
              * Lookup: 4(4+1)/2 + 2 = 12
+             * 
+             * Offsets are 64-bit: i(i+1)/2 overflows an int once i reaches 46341.
              */
             std::vector<T> distance;
+
+            // The entries: distance.data(), or the mapping of file
+            T* values;
+            std::shared_ptr<MappedFile> file;
     };
 }
 
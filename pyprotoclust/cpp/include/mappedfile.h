@@ -0,0 +1,64 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace minimax {
+
+    /**
+     *  Expected access to a mapped file, passed to the kernel as a madvise hint.
+     *
+     *  normal:     Read ahead around each fault, for scans along contiguous rows.
+     *  sequential: Read ahead aggressively and drop pages behind, for a single pass such as a load.
+     *  random:     Fault single pages, for walks that touch one entry per page (e.g. a column of a triangle).
+     **/
+    enum class Access { normal, sequential, random };
+
+    /**
+     *  A file mapped into memory. Pages are read on first access and dirty pages are written back
+     *  under memory pressure, so a matrix stored in a mapped file only needs its working set in RAM.
+     **/
+    class MappedFile {
+        public:
+            /**
+             *  Map a new zero-filled file of bytes in directory, read-write. The file is unlinked once
+             *  mapped, stays sparse until written and is released with the mapping.
+             *
+             *  Throws std::runtime_error if the file cannot be created or mapped.
+             **/
+            static std::shared_ptr<MappedFile> temporary(const std::string& directory, std::size_t bytes);
+
+            /**
+             *  Map bytes of the existing file at path from offset (any alignment), read-only.
+             *
+             *  Throws std::runtime_error if the file is shorter or cannot be mapped.
+             **/
+            static std::shared_ptr<MappedFile> open(const std::string& path, std::size_t offset, std::size_t bytes);
+
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            void* data() const { return this->begin; };
+            std::size_t size() const { return this->bytes; };
+            bool writable() const { return this->write; };
+
+            void advise(Access access);
+
+        private:
+            MappedFile(int fd, std::size_t offset, std::size_t bytes, bool write);
+
+            // The mapping starts at the page holding offset; begin is offset within it
+            void* mapping;
+            std::size_t mapping_size;
+            void* begin;
+            std::size_t bytes;
+            bool write;
+    };
+
+}
+
+#endif
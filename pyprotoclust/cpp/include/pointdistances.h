@@ -0,0 +1,106 @@
+#ifndef POINTDISTANCES_H
+#define POINTDISTANCES_H
+
+#include "bitvectors.h"
+#include "featurevectors.h"
+#include "ltmatrix.h"
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace minimax {
+
+    /**
+     *  Storage type of the distances between the points.
+     *
+     *  float32:        The distances.
+     *  float16:        The bits of the nearest IEEE half, as std::uint16_t.
+     *  bfloat16:       The bits of the nearest bfloat16 (the upper half of a float), as std::uint16_t.
+     *  uint16, uint8:  round((distance - offset) / scale), clamped to the range of the type.
+     *
+     *  Every code is nondecreasing in the distance (the narrow types store negative distances as 0),
+     *  so the linkage takes its minima and maxima over the codes and decodes only its results.
+     **/
+    enum class DistanceType { float32, float16, bfloat16, uint16, uint8 };
+
+    struct Quantization {
+        DistanceType type = DistanceType::float32;
+        float scale = 1;    // uint16 and uint8 only, must be positive
+        float offset = 0;   // uint16 and uint8 only
+
+        // The code of distance, an integer below 2^16 for the narrow types
+        float encode(float distance) const;
+        float decode(float code) const;
+    };
+
+    /**
+     *  The distances between the points in the storage type of a Quantization. Reads return the
+     *  codes as floats, which is exact, and decode turns codes back into distances.
+     *
+     *  Distances computed from FeatureVectors or BitVectors are float32 and stored nowhere: set throws
+     *  and layout is packed, the layout of the matrices derived from them. set also throws for
+     *  distances mapped read-only from a file (see: LTMatrix::read_only).
+     **/
+    class PointDistances {
+        public:
+            PointDistances() {};
+            PointDistances(std::shared_ptr<LTMatrix<float> > matrix);
+            PointDistances(std::shared_ptr<LTMatrix<std::uint16_t> > matrix, Quantization quantization);
+            PointDistances(std::shared_ptr<LTMatrix<std::uint8_t> > matrix, Quantization quantization);
+            PointDistances(std::shared_ptr<FeatureVectors> features);
+            PointDistances(std::shared_ptr<BitVectors> bits);
+
+            // Store the code of distance at (i, j) and return the distance it decodes to
+            float set(std::size_t i, std::size_t j, float distance);
+
+            float code(std::size_t i, std::size_t j) const {
+                return this->visit([&](const auto& d) { return float(d.get(i, j)); });
+            };
+            float decode(float code) const { return this->quantization.decode(code); };
+
+            std::size_t size() const { return this->visit([](const auto& d) { return d.size(); }); };
+            MatrixLayout layout() const;
+            DistanceType type() const { return this->quantization.type; };
+            void advise(Access access);
+
+            // The float storage, null for the narrow types
+            const LTMatrix<float>* floats() const { return this->f32.get(); };
+
+            // The feature vectors, null for stored distances
+            const FeatureVectors* features() const { return this->points.get(); };
+
+            // Whether the distances are computed on demand (from feature or bit vectors)
+            bool computed() const { return this->points || this->bits; };
+
+            // The decoded distances into matrix, of the same size
+            void copy_to(LTMatrix<float>& matrix) const;
+
+            // Call f with the matrix in use, as f(const LTMatrix<T>&) for the storage type T, or with the
+            // vectors the distances are computed from, as f(const FeatureVectors&) or f(const BitVectors&)
+            template <class F>
+            auto visit(F f) const -> decltype(f(std::declval<const LTMatrix<float>&>())) {
+                if (this->points)
+                    return f(*this->points);
+                if (this->bits)
+                    return f(*this->bits);
+                if (this->f32)
+                    return f(*this->f32);
+                if (this->u16)
+                    return f(*this->u16);
+                return f(*this->u8);
+            };
+
+        private:
+            Quantization quantization;
+
+            // Exactly one is set, by the storage type (or the vectors)
+            std::shared_ptr<LTMatrix<float> > f32;
+            std::shared_ptr<LTMatrix<std::uint16_t> > u16;
+            std::shared_ptr<LTMatrix<std::uint8_t> > u8;
+            std::shared_ptr<FeatureVectors> points;
+            std::shared_ptr<BitVectors> bits;
+    };
+
+}
+
+#endif
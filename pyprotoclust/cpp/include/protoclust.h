@@ -4,25 +4,135 @@
 #include "chain.h"
 #include "linkage.h"
 #include "ltmatrix.h"
+#include "pointdistances.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
 #include <vector>
 #include <memory>
 
 namespace minimax {
 
+    /**
+     *  Progress report for Protoclust::compute. Receives the caller's data pointer and the number
+     *  of merges completed so far. Returning false stops the computation after the current merge.
+     **/
+    typedef bool (*ProgressCallback)(void* data, int merges);
+
     class Protoclust {
 
         public:
-            Protoclust() {
-                this->n_elems = 0;
-            };
-            Protoclust(int n);
-            Protoclust(const std::vector< std::vector<float>>& dm);
+            Protoclust() {};
+            /**
+             *  The layout applies to the distances between the points, which the linkage reads (see:
+             *  MatrixLayout). The distances between clusters are packed, or square with a square layout.
+             * 
+             *  With a directory, the distance matrices are kept in temporary files there, mapped into
+             *  memory (see: MappedFile), so that only the pages in use need RAM. The eccentricity
+             *  engine (opt-in) still keeps n floats in memory per merged cluster awaiting a merge, up
+             *  to n^2 / 2 floats in all, as much as the packed distances.
+             * 
+             *  The quantization selects the storage type of the distances between the points (see:
+             *  DistanceType); the distances between clusters are the decoded distances, as floats.
+             **/
+            Protoclust(int n, LinkageEngine engine = LinkageEngine::all_pairs,
+                       MatrixLayout layout = MatrixLayout::packed, const std::string& directory = "",
+                       Quantization quantization = Quantization());
+            /**
+             *  Cluster the rows of the row-major n by dim array features under metric. The distances
+             *  between the points are computed on demand from a copy of the rows (see: FeatureVectors) and
+             *  never stored: only the distances between clusters are, as above (packed, or square with
+             *  a square layout). They start as the distances between the points, computed on the worker
+             *  pool on the first merge.
+             **/
+            Protoclust(const float* features, int n, int dim, FeatureMetric metric,
+                       LinkageEngine engine = LinkageEngine::all_pairs,
+                       MatrixLayout layout = MatrixLayout::packed, const std::string& directory = "");
+            /**
+             *  As above, for the rows of the row-major n by bytes array bits, bit vectors compared by
+             *  popcounts under metric (see: BitVectors).
+             **/
+            Protoclust(const std::uint8_t* bits, int n, int bytes, BitMetric metric,
+                       LinkageEngine engine = LinkageEngine::all_pairs,
+                       MatrixLayout layout = MatrixLayout::packed, const std::string& directory = "");
+            /**
+             *  Read the n points' distances from a file holding the condensed distance vector (see:
+             *  set_condensed_distances) as float32 from offset, mapped read-only as the distance matrix
+             *  rather than loaded. The distances between clusters start as a copy of the file, in memory
+             *  or in directory; both are stored condensed (see: MatrixLayout).
+             * 
+             *  Throws std::runtime_error if the file cannot be mapped.
+             **/
+            Protoclust(const std::string& path, std::size_t offset, int n,
+                       LinkageEngine engine = LinkageEngine::all_pairs, const std::string& directory = "");
+            Protoclust(const std::vector< std::vector<float>>& dm,
+                       LinkageEngine engine = LinkageEngine::all_pairs,
+                       MatrixLayout layout = MatrixLayout::packed);
 
             /**
-             *  Set distance_matrix[i, j] = distance_matrix[j, i] = distance.
+             *  Set distance_matrix[i, j] = distance_matrix[j, i] = distance, rounded to the storage type.
+             * 
+             *  Throws std::runtime_error if the distances are computed from features.
              **/
             void set_distance(int i, int j, float distance);
 
+            /**
+             *  Load every distance from a condensed distance vector in one pass. The condensed
+             *  ordering is that of scipy.spatial.distance.pdist: the distance between i < j is
+             *  stored at n*i - i*(i+1)/2 + (j-i-1), for n*(n-1)/2 entries in total.
+             **/
+            void set_condensed_distances(const float* condensed);
+            void set_condensed_distances(const double* condensed);
+
+            /**
+             *  Compute and store every distance between the rows of the row-major n by dim array
+             *  features under metric, in place of set_distance. The triangle is cut into row tiles of
+             *  feature_tile rows, built in parallel on the worker pool one feature_tile square at a time
+             *  (see: FeatureVectors::block) and written straight into the distance matrices.
+             **/
+            void set_feature_distances(const float* features, int dim, FeatureMetric metric);
+
+            /**
+             *  Set the number of threads (including the caller) for the distance updates after each
+             *  merge; 0 uses the hardware concurrency. The threads are started on the first merge
+             *  and kept until the next call or the destruction of this object.
+             **/
+            void set_num_threads(int num_threads);
+
+            /**
+             *  Evaluate linkages on demand. Instead of linking each merged cluster to every available
+             *  cluster, a merge records lower bounds from the distances between the merged parts and
+             *  the chain evaluates only the linkages whose bound could beat a nearest neighbor. Runs
+             *  the evaluations on the calling thread. Call before the first merge.
+             **/
+            void set_lazy(bool lazy);
+
+            /**
+             *  Declare that the distances satisfy the triangle inequality. The minimax radius of a
+             *  union then lies between half its diameter and its diameter, and lazy evaluation keeps
+             *  the diameter of the union of each pair of clusters (an extra matrix the size of the
+             *  distance matrix) to tighten its bounds. Call before the first merge.
+             **/
+            void set_metric(bool metric);
+
+            /**
+             *  Fix the random start of the nearest-neighbor chains, making compute reproducible.
+             *  Call before the first merge.
+             **/
+            void set_seed(unsigned int seed) { this->chain.set_seed(seed); };
+
+            /**
+             *  Stop compute before merging clusters farther apart than radius, or once the given number
+             *  of clusters remain, whichever comes first. The merges made are exactly those of the full
+             *  clustering up to that height, or the n_elems - clusters lowest of them: chains ending
+             *  beyond the radius are retired (see: Chain::retire_chain), and the merges found past the
+             *  count are dropped again (see: truncate). Call before the first merge.
+             **/
+            void set_max_radius(double radius) { this->max_radius = radius; };
+            void set_min_clusters(int clusters) { this->min_clusters = std::max(clusters, 1); };
+
             /**
              * Computes the hierarchical clustering according to the minimax linkage.
              * 
@@ -30,6 +140,20 @@ namespace minimax {
              */
             void compute();
 
+            /**
+             * Computes the hierarchical clustering, reporting progress every interval merges and after
+             * the final merge. The callback runs on the calling thread, so a caller that released an
+             * interpreter lock can reacquire it only for the report. Merges run in rounds (see:
+             * compute_round) whatever the interval; the reports at the multiples of interval that a
+             * round passes are made once it is done. Without a callback (null) nothing is reported.
+             * The merges stop when a stop criterion is met (see: set_max_radius), which sets the
+             * clusters that remain (see: get_label).
+             * 
+             * Returns:
+             *      - false if the callback stopped the computation early, true otherwise.
+             */
+            bool compute(ProgressCallback callback, void* data, int interval);
+
             /**
              * This function computes an iteration of the linkage algorithm (there are n_elems-1 
              * total such linkages). This function is exposed to allow external programs to manage 
@@ -44,21 +168,91 @@ namespace minimax {
              */
             void compute_index(const int i);
 
+            /**
+             * Merge every recurrent pair of nearest neighbors known after growing the chain, up to
+             * max_merges of them, as merges i, i+1, ... The linkages of the pairs and the distance
+             * updates that follow run in one parallel pass each. Pairs farther apart than the ceiling
+             * set by compute are not merged (see: Chain::recurrent_pairs).
+             * 
+             * Assumes the same as compute_index, with i + max_merges <= n_elems - 1.
+             * 
+             * Returns:
+             *      - the number of merges made (at least 1, or 0 if the chain was retired instead).
+             */
+            int compute_round(const int i, const int max_merges);
+
+            /**
+             * Cut the clustering at each of n_thresholds heights in one pass over the merges, as
+             * scipy.cluster.hierarchy.fcluster with criterion 'distance': the merges no higher than
+             * a threshold are made. labels (row-major n_elems by n_thresholds) receives the cluster
+             * of each point at each threshold, numbered by first point (see: get_label), and
+             * prototypes[t] the prototype of each cluster at threshold t. The thresholds are cut in
+             * parallel on the worker pool.
+             * 
+             * Assumes that compute has finished.
+             */
+            void cut(const double* thresholds, int n_thresholds, int* labels,
+                     std::vector< std::vector<int>>& prototypes);
+
             // Accessors
             int get_Z_0(int i) { return this->Z_0[i]; };
             int get_Z_1(int i) { return this->Z_1[i]; };
             double get_Z_2(int i) { return this->Z_2[i]; };
             int get_Z_3(int i) { return this->Z_3[i]; };
             int get_cluster_center(int i) { return this->cluster_centers[i]; };
+            int get_n_merges() { return this->n_merges; };
+            int get_n_elems() { return this->n_elems; };
+
+            // The clusters that remain after compute, numbered by their first point, and their prototypes
+            int get_n_clusters() { return this->prototypes.size(); };
+            int get_label(int i) { return this->labels[i]; };
+            int get_prototype(int c) { return this->prototypes[c]; };
+            long long get_chain_steps() { return this->chain.get_steps(); };
+            long long get_lazy_evaluations() { return this->chain.get_evaluations(); };
+            long long get_rounds() { return this->chain.get_rounds(); };
 
         private:
-            int n_elems;
+            // Defaults shared by every constructor are set where declared; the storage by initialize
+            int n_elems = 0;
+            LinkageEngine engine = LinkageEngine::all_pairs;
+
+            // Directory of the mapped distance matrices, or empty to keep them in memory
+            std::string directory;
+            template <class T>
+            std::shared_ptr<LTMatrix<T> > new_matrix(MatrixLayout layout) const;
 
-            // Full distance matrix (n_elems initial points and n_elems-1 joins)
-            std::shared_ptr<LTMatrix<float> > full_distance_matrix;
+            // Set up the slot distances, chain, linkage and clusters once distance_matrix is set
+            void initialize(MatrixLayout layout);
+
+            // Set the slot distances to the distances computed from the vectors (see: PointDistances::computed)
+            void load_computed_distances();
+
+            // Distances between the original points (n_elems)
+            PointDistances distance_matrix;
+
+            /**
+             * Distances between the available clusters, stored by slot (n_elems). A merge recycles
+             * the slot of one of the merged clusters for the new cluster and retires the other, so
+             * the chain works on slots and slot_cluster maps each slot to its cluster index.
+             */
+            std::shared_ptr<LTMatrix<float> > cluster_distance_matrix;
+            std::vector<int> slot_cluster; // Length: n_elems
             Chain chain;
             Linkage linkage;
 
+            // Worker threads for the distance updates, shared by copies of this object
+            int num_threads = 0;
+            std::shared_ptr<ThreadPool> pool;
+
+            // Total update weight (see: update_distances) below which the updates run serially
+            static constexpr double parallel_cutoff = 1 << 14;
+
+            // Rescans of unknown nearest neighbors per recurrent pair found (see: Chain::recurrent_pairs)
+            static constexpr std::size_t sweep_rescans = 8;
+
+            // Rows and columns of the blocks of distances computed from features at a time
+            static constexpr std::size_t feature_tile = 64;
+
             /** 
              * Elements of the n-1 by 4 linkage matrix (for scipy.cluster.hierarchy.linkage)
              *   Z[i, 0] and Z[i, 1] are combined to form cluster n+i. 
@@ -71,12 +265,52 @@ namespace minimax {
             std::vector<int> Z_3;
             void update_Z(int i, int i0, int i1, double i2, int i3);
 
-            // The original indices comprising the cluster associated with each index
-            std::vector< std::vector<int>> cluster; // Length: 2 n_elems -1
+            // Stop criteria (see: set_max_radius) and the bound on the distance of the pairs merged
+            float max_radius = std::numeric_limits<float>::infinity();
+            int min_clusters = 1;
+            float ceiling = std::numeric_limits<float>::infinity();
+
+            // Rows of Z, n_elems - 1 unless compute stopped early
+            int n_merges = 0;
+
+            /**
+             *  Keep the limit lowest of the first merges (if more), renumbered by height, and label the
+             *  points by the cluster that holds them once these merges are made.
+             **/
+            void truncate(int merges, int limit);
+
+            // Number the clusters root[p] of the points p by first point, listing their prototypes
+            void label(const std::vector<int>& root, int* labels, std::vector<int>& prototypes) const;
+            std::vector<int> labels; // Length: n_elems
+            std::vector<int> prototypes;
+
+            // Merge the clusters in slots rnn1 and rnn2 as merge i (see: compute_round)
+            void merge_pair(const int i, const int rnn1, const int rnn2);
+
+            // Set the distances from the slots merged from merge i on to the available slots
+            void update_distances(const int i, const std::vector<int>& merged);
+
+            // Set lower bounds of the same distances instead (see: set_lazy)
+            bool lazy = false;
+            bool metric = false;
+            std::shared_ptr<LTMatrix<float> > diameter_matrix; // Diameter of each union by slot (see: set_metric)
+            void bound_distances(const int i, const std::vector<std::pair<int, int> >& pairs);
+
+            // Minimax linkage between the clusters in slots a and b
+            double slot_linkage(const int a, const int b);
+
+            template <class T>
+            void load_condensed(const T* condensed);
+
+            // The original indices comprising the cluster in each slot (empty for retired slots)
+            std::vector< std::vector<int>> cluster; // Length: n_elems
 
             // The original index associated with the center of each index.
             std::vector<int> cluster_centers; // Length: 2 n_elems -1
 
+            // Eccentricity vectors of the merged clusters by slot (empty otherwise, see: LinkageEngine)
+            std::vector< std::vector<float>> eccentricity; // Length: n_elems
+
     };
 
 }
@@ -0,0 +1,85 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace minimax {
+
+    /**
+     *  Persistent worker threads for the parallel loops of the clustering.
+     *
+     *  The workers are started once and sleep between loops, so a loop costs a wake-up rather than
+     *  a thread fork/join. Each loop is cut into ranges of roughly equal weight that are dealt to
+     *  per-participant queues; a participant whose queue runs dry steals from the back of the others.
+     *  The calling thread takes part in every loop.
+     **/
+    class ThreadPool {
+        public:
+            // num_threads counts the calling thread; 0 uses the hardware concurrency
+            ThreadPool(int num_threads);
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            // Number of participants, including the calling thread
+            int size() const { return static_cast<int>(this->queues.size()); };
+
+            /**
+             *  Call body(k) for k in [0, n). The cost of body(k) is estimated by weight(k).
+             *
+             *  Loops with a total weight below serial_cutoff (or a single participant) run on the
+             *  calling thread, where a wake-up would cost more than it saves.
+             * 
+             *  If body throws, the ranges not yet started are skipped and the first exception is
+             *  rethrown here once every participant has left the loop.
+             **/
+            void parallel_for(std::size_t n, const std::function<void(std::size_t)>& body,
+                              const std::function<double(std::size_t)>& weight, double serial_cutoff);
+
+        private:
+            typedef std::pair<std::size_t, std::size_t> Range;
+
+            struct Queue {
+                std::mutex lock;
+                std::deque<Range> ranges;
+            };
+
+            std::vector<std::unique_ptr<Queue> > queues; // Index 0 is the calling thread
+            std::vector<std::thread> workers;
+
+            std::mutex lock;
+            std::condition_variable wake;
+            std::condition_variable done;
+            std::size_t generation;
+            bool stop;
+
+            const std::function<void(std::size_t)>* body;
+            std::atomic<std::size_t> pending;
+
+            // First exception thrown by body in the current loop (guarded by lock)
+            std::exception_ptr error;
+            std::atomic<bool> failed;
+
+            // Take a range from the own queue (front) or steal one from another queue (back)
+            bool pop(int self, Range& range);
+
+            // Run ranges until every queue is empty
+            void work(int self);
+
+            void worker_main(int self);
+    };
+
+}
+
+#endif
@@ -0,0 +1,33 @@
+#include "bitvectors.h"
+#include "kernels.h"
+#include <cstring>
+
+namespace minimax {
+
+    BitVectors::BitVectors(const std::uint8_t* data, std::size_t n, std::size_t bytes, BitMetric metric) {
+        this->s = n;
+        this->m = metric;
+        std::size_t words = (bytes + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+        this->stride = (words + alignment - 1) / alignment * alignment;
+        this->values = std::vector<std::uint64_t>(n * this->stride, 0);
+        for (std::size_t i = 0; i < n; ++i)
+            std::memcpy(this->values.data() + i*this->stride, data + i*bytes, bytes);
+
+        if (metric == BitMetric::tanimoto) {
+            this->counts.resize(n);
+            for (std::size_t i = 0; i < n; ++i)
+                this->counts[i] = kernels::popcount_and(this->row(i), this->row(i), this->stride);
+        }
+    }
+
+    float BitVectors::get(std::size_t i, std::size_t j) const {
+        if (this->m == BitMetric::hamming)
+            return static_cast<float>(kernels::popcount_xor(this->row(i), this->row(j), this->stride));
+
+        // |a | b| = |a| + |b| - |a & b|
+        std::size_t shared = kernels::popcount_and(this->row(i), this->row(j), this->stride);
+        std::size_t either = this->counts[i] + this->counts[j] - shared;
+        return either == 0 ? 0.0f : 1 - static_cast<float>(shared) / static_cast<float>(either);
+    }
+
+}
@@ -7,13 +7,12 @@ namespace minimax{
 
     // -- Public
 
-    Chain::Chain(std::shared_ptr<LTMatrix<float> > full_distance_matrix){
-        // Requires 2*n_elems - 1 less than RAND_MAX and INT_MAX
-        // full_distance_matrix has 2*n_elems-1 entries
-        this->n_elems = (full_distance_matrix->size()+1)/2;
+    Chain::Chain(std::shared_ptr<LTMatrix<float> > cluster_distance_matrix){
+        // Requires n_elems less than RAND_MAX and INT_MAX
+        // cluster_distance_matrix has one slot per original point
+        this->n_elems = static_cast<int>(cluster_distance_matrix->size());
 
-        // Construct random number generator
-        // TODO: Allow fixed random seed for testing
+        // Construct random number generator (see: set_seed)
         std::random_device rand_dev;
         this->generator = std::default_random_engine(rand_dev());
 
@@ -21,17 +20,23 @@ namespace minimax{
         this->chain.reserve(this->n_elems);
 
         // Available indices are originally {0,1,...,n-1}
-        this->available_indicies.reserve(this->n_elems);
+        this->available_indicies = IndexSet(this->n_elems);
         for (int i = 0; i < this->n_elems; ++i)
-            this->available_indicies.emplace_back(i);
+            this->available_indicies.insert(i);
 
-        // Load full matrix (n initial and n-1 joins)
-        this->full_distance_matrix = full_distance_matrix;
+        // Load slot matrix (n slots, recycled by merges)
+        this->cluster_distance_matrix = cluster_distance_matrix;
+
+        // No neighbors are known until the chain first visits a slot
+        this->nn_index.assign(this->n_elems, -1);
+        this->nn_distance.assign(this->n_elems, std::numeric_limits<float>::max());
+
+        this->steps = 0;
+        this->evaluations = 0;
+        this->rounds = 0;
     }
 
     void Chain::grow_chain() {
-        // TODO: How should chain handle equal entries in neighbor search? (causes self-loops)
-
         // Empty? Randomly start chain 
         if (this->chain.empty()) {
             std::uniform_int_distribution<int>  distr(0, this->available_indicies.size()-1);
@@ -39,9 +44,11 @@ namespace minimax{
             this->chain.emplace_back(this->available_indicies[r]);
         }
 
-        // Guaranteed to exit before completing this worst-case loop
+        // Each link is strictly closer than the last in the (distance, slot) order (see: closer), so
+        // the chain never revisits a slot and ends at a recurrent pair within the available slots.
         for (unsigned int i = 0; i < this->available_indicies.size() - 1; ++i) {
             int neighbor = this->nearest(this->chain.back());
+            ++this->steps;
             // Check for a recurrent nearest neighbor (in chain: {..ab}, neighbor: a)
             if (this->chain.size() > 1 && this->chain[this->chain.size()-2] == neighbor)
                 break;
@@ -50,38 +57,179 @@ namespace minimax{
         }
     }
 
-    void Chain::merge_indicies(int r1, int r2, int iteration) {
-        this->available_indicies.erase(
-             std::remove( this->available_indicies.begin(), this->available_indicies.end(), r1 ),
-             this->available_indicies.end() );
-        this->available_indicies.erase(
-             std::remove( this->available_indicies.begin(), this->available_indicies.end(), r2 ),
-             this->available_indicies.end() );
+    void Chain::merge_indicies(const std::vector<std::pair<int, int> >& pairs, const std::vector<int>& merged) {
+        // Mark the slots of the merged pairs
+        std::vector<char> is_paired(this->n_elems, 0);
+        for (auto& pair : pairs) {
+            is_paired[pair.first] = 1;
+            is_paired[pair.second] = 1;
+        }
+
+        // The links up to the first merged slot stay nearest neighbors; the rest of the chain is regrown
+        for (std::size_t k = 0; k < this->chain.size(); ++k) {
+            if (is_paired[this->chain[k]]) {
+                this->chain.resize(k);
+                break;
+            }
+        }
+
+        for (auto& pair : pairs) {
+            this->available_indicies.remove(pair.first);
+            this->available_indicies.remove(pair.second);
+            this->nn_index[pair.first] = -1;
+            this->nn_index[pair.second] = -1;
+        }
 
-        // The new index reps the joining of the removed pair
-        this->available_indicies.emplace_back(this->n_elems + iteration); 
+        // The recycled slots rep the joining of the removed pairs
+        for (auto m : merged)
+            this->available_indicies.insert(m);
+
+        // Only distances to the merged slots changed: neighbors that were merged are rescanned on
+        // demand and the other neighbors are replaced only if a merged cluster is closer.
+        for (auto a : this->available_indicies.get_values()) {
+            if (this->nn_index[a] == -1)
+                continue;
+            if (is_paired[this->nn_index[a]]) {
+                this->nn_index[a] = -1;
+                continue;
+            }
+            for (auto m : merged) {
+                // A pending bound that is not closer rules the merged cluster out without evaluation
+                float distance = this->cluster_distance_matrix->get(m, a);
+                if (closer(distance, m, this->nn_distance[a], this->nn_index[a]) && this->is_pending(a, m))
+                    distance = this->evaluate(a, m);
+                if (closer(distance, m, this->nn_distance[a], this->nn_index[a])) {
+                    this->nn_index[a] = m;
+                    this->nn_distance[a] = distance;
+                }
+            }
+        }
+    }
+
+    void Chain::set_evaluator(Evaluator evaluator) {
+        if (this->pending.empty())
+            this->pending.resize(LTMatrix<float>::offset(this->n_elems, 0) / 64 + 1, 0);
+        this->evaluator = evaluator;
     }
 
-    // NOTE: Fails to remove all occurences of end values in the case of 
-    //       self loops caused by equal values (see: grow_chain())
-    void Chain::trim_chain() {
-        int remove_two = 0;
-        while (!this->chain.empty() && remove_two < 2) {
-            this->chain.pop_back();
-            remove_two++;
+    void Chain::set_bound(int i, int j, float bound) {
+        this->cluster_distance_matrix->set(i, j, bound);
+        std::size_t k = offset(i, j);
+        this->pending[k / 64] |= std::uint64_t(1) << (k % 64);
+    }
+
+    float Chain::evaluate(int i, int j) {
+        float distance = this->evaluator(i, j);
+        this->cluster_distance_matrix->set(i, j, distance);
+        std::size_t k = offset(i, j);
+        this->pending[k / 64] &= ~(std::uint64_t(1) << (k % 64));
+        ++this->evaluations;
+        return distance;
+    }
+
+    void Chain::recurrent_pairs(std::vector<std::pair<int, int> >& pairs, std::size_t max_pairs,
+                                std::size_t rescans_per_pair, float ceiling) {
+        ++this->rounds;
+        pairs.clear();
+        int end_1 = this->chain_end_1();
+        int end_2 = this->chain_end_2();
+        // The chain grew from end_2 to its nearest neighbor end_1 (which may not have looked back)
+        if (this->nn_distance[end_2] > ceiling)
+            return;
+        pairs.emplace_back(end_2, end_1);
+        if (max_pairs < 2)
+            return;
+
+        // Sweep every slot. A slot whose neighbor is unknown (never looked up, or merged since) costs a
+        // pass over the available slots, and with tied distances one merge can invalidate most of
+        // them while few rescans find a pair, so the rescans are budgeted by the pairs found.
+        std::size_t rescans = 0;
+        auto known = [&](int a) {
+            if (this->nn_index[a] != -1)
+                return true;
+            if (rescans >= rescans_per_pair * pairs.size())
+                return false;
+            ++rescans;
+            this->nearest(a);
+            return true;
+        };
+        for (auto a : this->available_indicies.get_values()) {
+            if (!known(a))
+                continue;
+            int b = this->nn_index[a];
+            if (a > b || !known(b) || this->nn_index[b] != a || this->nn_distance[a] > ceiling)
+                continue;
+            bool at_end = a == end_1 || a == end_2 || b == end_1 || b == end_2;
+            if (!at_end) {
+                pairs.emplace_back(a, b);
+                if (pairs.size() == max_pairs)
+                    break;
+            }
+        }
+    }
+
+    void Chain::retire_chain() {
+        std::vector<char> is_retired(this->n_elems, 0);
+        for (auto a : this->chain) {
+            is_retired[a] = 1;
+            this->available_indicies.remove(a);
+            this->nn_index[a] = -1;
         }
+        this->chain.clear();
+
+        // Neighbors that were retired are rescanned on demand
+        for (auto a : this->available_indicies.get_values())
+            if (this->nn_index[a] != -1 && is_retired[this->nn_index[a]])
+                this->nn_index[a] = -1;
     }
 
     int Chain::nearest(int index) {
+        if (this->nn_index[index] != -1)
+            return this->nn_index[index];
+
         int nearest = -1;
-        double nearest_dist = std::numeric_limits<double>::max();
+        float nearest_dist = std::numeric_limits<float>::max();
+        std::vector<std::pair<float, int> > bounds;
+        float ceiling = std::numeric_limits<float>::max();
+
+        // Square storage holds the distances from index contiguously (see: MatrixLayout)
+        const LTMatrix<float>& d = *this->cluster_distance_matrix;
+        const float* row = d.layout() == MatrixLayout::square ? d.row(index) : nullptr;
         
-        for (auto j : this->available_indicies) {
+        for (auto j : this->available_indicies.get_values()) {
             if (j == index)
                 continue;
-            else if (this->full_distance_matrix->get(index, j) < nearest_dist) {
+            float distance = row ? row[j] : d.get(index, j);
+            if (this->is_pending(index, j)) {
+                bounds.emplace_back(distance, j);
+                if (this->upper)
+                    ceiling = std::min(ceiling, this->upper->get(index, j));
+            } else if (nearest == -1 || closer(distance, j, nearest_dist, nearest)) {
                 nearest = j;
-                nearest_dist = this->full_distance_matrix->get(index, j);
+                nearest_dist = distance;
+            }
+        }
+
+        // Drop the pending distances that cannot reach the least upper bound
+        if (this->upper) {
+            ceiling = std::min(ceiling, nearest_dist);
+            auto above = [ceiling](const std::pair<float, int>& bound) { return bound.first > ceiling; };
+            bounds.erase(std::remove_if(bounds.begin(), bounds.end(), above), bounds.end());
+        }
+
+        // Evaluate pending distances by increasing lower bound until no bound can beat the nearest
+        // (a min-heap, as usually only the first few bounds are visited)
+        auto later = std::greater<std::pair<float, int> >();
+        std::make_heap(bounds.begin(), bounds.end(), later);
+        for (auto end = bounds.end(); end != bounds.begin(); --end) {
+            std::pop_heap(bounds.begin(), end, later);
+            const std::pair<float, int>& bound = *(end - 1);
+            if (nearest != -1 && !closer(bound.first, bound.second, nearest_dist, nearest))
+                break;
+            float distance = this->evaluate(index, bound.second);
+            if (nearest == -1 || closer(distance, bound.second, nearest_dist, nearest)) {
+                nearest = bound.second;
+                nearest_dist = distance;
             }
         }
 
@@ -91,6 +239,8 @@ namespace minimax{
             throw std::runtime_error(s.str());
         }
 
+        this->nn_index[index] = nearest;
+        this->nn_distance[index] = nearest_dist;
         return nearest;
     }
 
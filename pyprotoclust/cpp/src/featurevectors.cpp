@@ -0,0 +1,73 @@
+#include "featurevectors.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace minimax {
+
+    FeatureVectors::FeatureVectors(const float* data, std::size_t n, std::size_t dim, FeatureMetric metric) {
+        this->s = n;
+        this->d = dim;
+        this->m = metric;
+        this->stride = (dim + alignment - 1) / alignment * alignment;
+        this->values = std::vector<float>(n * this->stride, 0);
+        for (std::size_t i = 0; i < n; ++i)
+            std::copy(data + i*dim, data + (i + 1)*dim, this->values.begin() + i*this->stride);
+
+        if (metric == FeatureMetric::cosine) {
+            for (std::size_t i = 0; i < n; ++i) {
+                float* x = this->values.data() + i*this->stride;
+                float norm = std::sqrt(kernels::dot(x, x, this->stride));
+                // Zero rows stay zero, orthogonal to every row
+                if (norm > 0)
+                    for (std::size_t k = 0; k < dim; ++k)
+                        x[k] /= norm;
+            }
+        } else if (metric == FeatureMetric::euclidean) {
+            this->norms.resize(n);
+            for (std::size_t i = 0; i < n; ++i)
+                this->norms[i] = kernels::dot(this->row(i), this->row(i), this->stride);
+        }
+    }
+
+    float FeatureVectors::get(std::size_t i, std::size_t j) const {
+        if (i == j)
+            return 0;
+        switch (this->m) {
+            case FeatureMetric::cosine:
+                return std::min(std::max(1 - kernels::dot(this->row(i), this->row(j), this->stride), 0.0f), 2.0f);
+            case FeatureMetric::manhattan:
+                return kernels::manhattan(this->row(i), this->row(j), this->stride);
+            default:
+                return std::sqrt(kernels::squared_euclidean(this->row(i), this->row(j), this->stride));
+        }
+    }
+
+    void FeatureVectors::block(std::size_t i0, std::size_t i1, std::size_t j0, std::size_t j1, float* out,
+                               std::size_t ldo) const {
+        if (this->m == FeatureMetric::manhattan) {
+            // No product form: one reduction per pair, over rows that stay in cache across the block
+            for (std::size_t i = i0; i < i1; ++i)
+                for (std::size_t j = j0; j < j1; ++j)
+                    out[(i - i0)*ldo + (j - j0)] = this->get(i, j);
+            return;
+        }
+
+        kernels::dot_block(this->row(i0), i1 - i0, this->row(j0), j1 - j0, this->stride, out, ldo);
+        for (std::size_t i = i0; i < i1; ++i) {
+            float* products = out + (i - i0)*ldo;
+            for (std::size_t j = j0; j < j1; ++j) {
+                float& p = products[j - j0];
+                if (i == j) {
+                    p = 0;
+                } else if (this->m == FeatureMetric::cosine) {
+                    p = std::min(std::max(1 - p, 0.0f), 2.0f);
+                } else {
+                    // Cancellation can leave a small negative square
+                    p = std::sqrt(std::max(this->norms[i] + this->norms[j] - 2*p, 0.0f));
+                }
+            }
+        }
+    }
+
+}
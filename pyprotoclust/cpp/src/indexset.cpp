@@ -0,0 +1,29 @@
+#include "indexset.h"
+
+namespace minimax {
+
+    IndexSet::IndexSet(int capacity) {
+        this->values.reserve(capacity);
+        this->position = std::vector<int>(capacity, -1);
+    }
+
+    void IndexSet::insert(int index) {
+        if (this->contains(index))
+            return;
+        this->position[index] = static_cast<int>(this->values.size());
+        this->values.emplace_back(index);
+    }
+
+    void IndexSet::remove(int index) {
+        if (!this->contains(index))
+            return;
+        // Move the last member into the hole left by index
+        int hole = this->position[index];
+        int last = this->values.back();
+        this->values[hole] = last;
+        this->position[last] = hole;
+        this->values.pop_back();
+        this->position[index] = -1;
+    }
+
+}
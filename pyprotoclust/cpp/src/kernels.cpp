@@ -0,0 +1,1121 @@
+#include "kernels.h"
+#include "ltmatrix.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINIMAX_X86_KERNELS
+// GCC 12 reports the placeholder operands that the AVX-512 intrinsics pass to their builtins
+// as uninitialized, at their lines in the header: only those lines are exempt
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#define MINIMAX_AVX2 __attribute__((target("avx2")))
+#define MINIMAX_AVX512 __attribute__((target("avx2,avx512f,avx512dq")))
+#define MINIMAX_POPCNT __attribute__((target("popcnt")))
+#define MINIMAX_VPOPCNT __attribute__((target("avx2,avx512f,avx512dq,avx512vpopcntdq")))
+#endif
+
+namespace minimax {
+namespace kernels {
+
+    namespace {
+
+        const float inf = std::numeric_limits<float>::infinity();
+
+        inline std::size_t lt_offset(int c, int x) {
+            std::size_t hi = std::max(c, x);
+            std::size_t lo = std::min(c, x);
+            return hi*(hi+1)/2 + lo;
+        }
+
+        // Fold per-lane minima into (best, position), keeping the first position on ties.
+        // Lanes with a negative position never held a value.
+        void reduce_min(const float* values, const int* positions, int lanes, float& best, std::size_t& position) {
+            for (int l = 0; l < lanes; ++l) {
+                if (positions[l] < 0)
+                    continue;
+                std::size_t p = positions[l];
+                if (values[l] < best || (values[l] == best && p < position)) {
+                    best = values[l];
+                    position = p;
+                }
+            }
+        }
+
+        // As reduce_min, for per-lane maxima
+        void reduce_max(const float* values, const int* positions, int lanes, float& best, std::size_t& position) {
+            for (int l = 0; l < lanes; ++l) {
+                if (positions[l] < 0)
+                    continue;
+                std::size_t p = positions[l];
+                if (values[l] > best || (values[l] == best && p < position)) {
+                    best = values[l];
+                    position = p;
+                }
+            }
+        }
+
+        // -- Scalar (templated on the type of the distances: float or a narrow code, see: Quantization)
+
+        template <class C>
+        float min_max_gather_scalar(const float* u, const C* v, const int* idx, std::size_t k,
+                                    std::size_t& position) {
+            float best = inf;
+            position = k;
+            for (std::size_t t = 0; t < k; ++t) {
+                float r = std::max(u[idx[t]], float(v[idx[t]]));
+                if (r < best) {
+                    best = r;
+                    position = t;
+                }
+            }
+            return best;
+        }
+
+        template <class C>
+        float min_max_gather_lt_scalar(const float* u, const C* lt, int c, const int* idx, std::size_t k,
+                                       std::size_t& position) {
+            float best = inf;
+            position = k;
+            for (std::size_t t = 0; t < k; ++t) {
+                float r = std::max(u[idx[t]], float(lt[lt_offset(c, idx[t])]));
+                if (r < best) {
+                    best = r;
+                    position = t;
+                }
+            }
+            return best;
+        }
+
+        template <class C>
+        float max_gather_lt_scalar(const C* lt, int c, const int* idx, std::size_t k, float cutoff,
+                                   std::size_t& position) {
+            float best = -inf;
+            position = k;
+            for (std::size_t t = 0; t < k; ++t) {
+                float r = lt[lt_offset(c, idx[t])];
+                if (r > best) {
+                    best = r;
+                    position = t;
+                    if (best > cutoff)
+                        break;
+                }
+            }
+            return best;
+        }
+
+        template <class C>
+        float max_gather_scalar(const C* v, const int* idx, std::size_t k, float cutoff, std::size_t& position) {
+            float best = -inf;
+            position = k;
+            for (std::size_t t = 0; t < k; ++t) {
+                float r = v[idx[t]];
+                if (r > best) {
+                    best = r;
+                    position = t;
+                    if (best > cutoff)
+                        break;
+                }
+            }
+            return best;
+        }
+
+        template <class C>
+        void max_row_lt_scalar(const float* u, const C* lt, int c, std::size_t n, float* out) {
+            for (std::size_t x = 0; x < n; ++x) {
+                float r = lt[lt_offset(c, static_cast<int>(x))];
+                out[x] = u ? std::max(u[x], r) : r;
+            }
+        }
+
+        // As max_row_lt, u may be null
+        template <class C>
+        void max_elementwise_scalar(const float* u, const C* v, std::size_t n, float* out) {
+            for (std::size_t x = 0; x < n; ++x)
+                out[x] = u ? std::max(u[x], float(v[x])) : float(v[x]);
+        }
+
+        float squared_euclidean_scalar(const float* a, const float* b, std::size_t dim) {
+            float sum = 0;
+            for (std::size_t k = 0; k < dim; ++k) {
+                float d = a[k] - b[k];
+                sum += d * d;
+            }
+            return sum;
+        }
+
+        float manhattan_scalar(const float* a, const float* b, std::size_t dim) {
+            float sum = 0;
+            for (std::size_t k = 0; k < dim; ++k)
+                sum += std::abs(a[k] - b[k]);
+            return sum;
+        }
+
+        float dot_scalar(const float* a, const float* b, std::size_t dim) {
+            float sum = 0;
+            for (std::size_t k = 0; k < dim; ++k)
+                sum += a[k] * b[k];
+            return sum;
+        }
+
+        void dot_block_scalar(const float* a, std::size_t rows, const float* b, std::size_t cols, std::size_t dim,
+                              float* out, std::size_t ldo) {
+            for (std::size_t r = 0; r < rows; ++r)
+                for (std::size_t c = 0; c < cols; ++c)
+                    out[r*ldo + c] = dot_scalar(a + r*dim, b + c*dim, dim);
+        }
+
+        // Bits set in x, without a popcount instruction
+        inline std::size_t popcount_swar(std::uint64_t x) {
+            x = x - ((x >> 1) & 0x5555555555555555ULL);
+            x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+            x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+            return static_cast<std::size_t>((x * 0x0101010101010101ULL) >> 56);
+        }
+
+        std::size_t popcount_xor_scalar(const std::uint64_t* a, const std::uint64_t* b, std::size_t words) {
+            std::size_t count = 0;
+            for (std::size_t k = 0; k < words; ++k)
+                count += popcount_swar(a[k] ^ b[k]);
+            return count;
+        }
+
+        std::size_t popcount_and_scalar(const std::uint64_t* a, const std::uint64_t* b, std::size_t words) {
+            std::size_t count = 0;
+            for (std::size_t k = 0; k < words; ++k)
+                count += popcount_swar(a[k] & b[k]);
+            return count;
+        }
+
+#ifdef MINIMAX_X86_KERNELS
+
+        // -- AVX2
+
+        // lt(c, x) for 8 points. Offsets are formed in 64-bit lanes: hi(hi+1) fits mul_epu32 since hi < 2^31.
+        MINIMAX_AVX2 inline __m256 lt_gather_avx2(const float* lt, __m256i c, __m256i x) {
+            const __m256i one = _mm256_set1_epi64x(1);
+            __m256i hi = _mm256_max_epi32(c, x);
+            __m256i lo = _mm256_min_epi32(c, x);
+            __m256i h0 = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(hi));
+            __m256i h1 = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(hi, 1));
+            __m256i l0 = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(lo));
+            __m256i l1 = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(lo, 1));
+            __m256i o0 = _mm256_add_epi64(_mm256_srli_epi64(_mm256_mul_epu32(h0, _mm256_add_epi64(h0, one)), 1), l0);
+            __m256i o1 = _mm256_add_epi64(_mm256_srli_epi64(_mm256_mul_epu32(h1, _mm256_add_epi64(h1, one)), 1), l1);
+            __m128 g0 = _mm256_i64gather_ps(lt, o0, 4);
+            __m128 g1 = _mm256_i64gather_ps(lt, o1, 4);
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(g0), g1, 1);
+        }
+
+        MINIMAX_AVX2 void reduce_min_avx2(__m256 best, __m256i best_t, float& value, std::size_t& position) {
+            float values[8];
+            int positions[8];
+            _mm256_storeu_ps(values, best);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(positions), best_t);
+            reduce_min(values, positions, 8, value, position);
+        }
+
+        MINIMAX_AVX2 void reduce_max_avx2(__m256 best, __m256i best_t, float& value, std::size_t& position) {
+            float values[8];
+            int positions[8];
+            _mm256_storeu_ps(values, best);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(positions), best_t);
+            reduce_max(values, positions, 8, value, position);
+        }
+
+        MINIMAX_AVX2 float min_max_gather_avx2(const float* u, const float* v, const int* idx, std::size_t k,
+                                               std::size_t& position) {
+            __m256 best = _mm256_set1_ps(inf);
+            __m256i best_t = _mm256_set1_epi32(-1);
+            __m256i t_vec = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i step = _mm256_set1_epi32(8);
+            std::size_t t = 0;
+            for (; t + 8 <= k; t += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + t));
+                __m256 r = _mm256_max_ps(_mm256_i32gather_ps(u, x, 4), _mm256_i32gather_ps(v, x, 4));
+                __m256 less = _mm256_cmp_ps(r, best, _CMP_LT_OQ);
+                best = _mm256_blendv_ps(best, r, less);
+                best_t = _mm256_blendv_epi8(best_t, t_vec, _mm256_castps_si256(less));
+                t_vec = _mm256_add_epi32(t_vec, step);
+            }
+            float value = inf;
+            position = k;
+            reduce_min_avx2(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = std::max(u[idx[t]], v[idx[t]]);
+                if (r < value) {
+                    value = r;
+                    position = t;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX2 float min_max_gather_lt_avx2(const float* u, const float* lt, int c, const int* idx,
+                                                  std::size_t k, std::size_t& position) {
+            __m256 best = _mm256_set1_ps(inf);
+            __m256i best_t = _mm256_set1_epi32(-1);
+            __m256i t_vec = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i step = _mm256_set1_epi32(8);
+            const __m256i c_vec = _mm256_set1_epi32(c);
+            std::size_t t = 0;
+            for (; t + 8 <= k; t += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + t));
+                __m256 r = _mm256_max_ps(_mm256_i32gather_ps(u, x, 4), lt_gather_avx2(lt, c_vec, x));
+                __m256 less = _mm256_cmp_ps(r, best, _CMP_LT_OQ);
+                best = _mm256_blendv_ps(best, r, less);
+                best_t = _mm256_blendv_epi8(best_t, t_vec, _mm256_castps_si256(less));
+                t_vec = _mm256_add_epi32(t_vec, step);
+            }
+            float value = inf;
+            position = k;
+            reduce_min_avx2(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = std::max(u[idx[t]], lt[lt_offset(c, idx[t])]);
+                if (r < value) {
+                    value = r;
+                    position = t;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX2 float max_gather_lt_avx2(const float* lt, int c, const int* idx, std::size_t k, float cutoff,
+                                              std::size_t& position) {
+            __m256 best = _mm256_set1_ps(-inf);
+            __m256i best_t = _mm256_set1_epi32(-1);
+            __m256i t_vec = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i step = _mm256_set1_epi32(8);
+            const __m256i c_vec = _mm256_set1_epi32(c);
+            const __m256 cut = _mm256_set1_ps(cutoff);
+            float value = -inf;
+            position = k;
+            std::size_t t = 0;
+            for (; t + 8 <= k; t += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + t));
+                __m256 r = lt_gather_avx2(lt, c_vec, x);
+                __m256 greater = _mm256_cmp_ps(r, best, _CMP_GT_OQ);
+                best = _mm256_blendv_ps(best, r, greater);
+                best_t = _mm256_blendv_epi8(best_t, t_vec, _mm256_castps_si256(greater));
+                t_vec = _mm256_add_epi32(t_vec, step);
+                // Abandon once any lane passes the cutoff
+                if (_mm256_movemask_ps(_mm256_cmp_ps(r, cut, _CMP_GT_OQ))) {
+                    reduce_max_avx2(best, best_t, value, position);
+                    return value;
+                }
+            }
+            reduce_max_avx2(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = lt[lt_offset(c, idx[t])];
+                if (r > value) {
+                    value = r;
+                    position = t;
+                    if (value > cutoff)
+                        break;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX2 float max_gather_avx2(const float* v, const int* idx, std::size_t k, float cutoff,
+                                           std::size_t& position) {
+            __m256 best = _mm256_set1_ps(-inf);
+            __m256i best_t = _mm256_set1_epi32(-1);
+            __m256i t_vec = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i step = _mm256_set1_epi32(8);
+            const __m256 cut = _mm256_set1_ps(cutoff);
+            float value = -inf;
+            position = k;
+            std::size_t t = 0;
+            for (; t + 8 <= k; t += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + t));
+                __m256 r = _mm256_i32gather_ps(v, x, 4);
+                __m256 greater = _mm256_cmp_ps(r, best, _CMP_GT_OQ);
+                best = _mm256_blendv_ps(best, r, greater);
+                best_t = _mm256_blendv_epi8(best_t, t_vec, _mm256_castps_si256(greater));
+                t_vec = _mm256_add_epi32(t_vec, step);
+                if (_mm256_movemask_ps(_mm256_cmp_ps(r, cut, _CMP_GT_OQ))) {
+                    reduce_max_avx2(best, best_t, value, position);
+                    return value;
+                }
+            }
+            reduce_max_avx2(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = v[idx[t]];
+                if (r > value) {
+                    value = r;
+                    position = t;
+                    if (value > cutoff)
+                        break;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX2 void max_row_lt_avx2(const float* u, const float* lt, int c, std::size_t n, float* out) {
+            // Row c of the triangle holds x <= c contiguously
+            const float* row = lt + lt_offset(c, 0);
+            std::size_t contiguous = std::min(n, static_cast<std::size_t>(c) + 1);
+            std::size_t x = 0;
+            for (; x + 8 <= contiguous; x += 8) {
+                __m256 r = _mm256_loadu_ps(row + x);
+                _mm256_storeu_ps(out + x, u ? _mm256_max_ps(_mm256_loadu_ps(u + x), r) : r);
+            }
+            for (; x < contiguous; ++x)
+                out[x] = u ? std::max(u[x], row[x]) : row[x];
+
+            // Column c holds x > c, one row apart
+            const __m256i c_vec = _mm256_set1_epi32(c);
+            __m256i x_vec = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(x)),
+                                             _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            const __m256i step = _mm256_set1_epi32(8);
+            for (; x + 8 <= n; x += 8) {
+                __m256 r = lt_gather_avx2(lt, c_vec, x_vec);
+                _mm256_storeu_ps(out + x, u ? _mm256_max_ps(_mm256_loadu_ps(u + x), r) : r);
+                x_vec = _mm256_add_epi32(x_vec, step);
+            }
+            for (; x < n; ++x) {
+                float r = lt[lt_offset(c, static_cast<int>(x))];
+                out[x] = u ? std::max(u[x], r) : r;
+            }
+        }
+
+        MINIMAX_AVX2 void max_elementwise_avx2(const float* u, const float* v, std::size_t n, float* out) {
+            std::size_t x = 0;
+            for (; x + 8 <= n; x += 8)
+                _mm256_storeu_ps(out + x, _mm256_max_ps(_mm256_loadu_ps(u + x), _mm256_loadu_ps(v + x)));
+            for (; x < n; ++x)
+                out[x] = std::max(u[x], v[x]);
+        }
+
+        // Eight narrow codes widened to float (exact: codes have at most 16 bits)
+        MINIMAX_AVX2 inline __m256 widen_avx2(const std::uint16_t* v) {
+            return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v))));
+        }
+
+        MINIMAX_AVX2 inline __m256 widen_avx2(const std::uint8_t* v) {
+            return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v))));
+        }
+
+        template <class C>
+        MINIMAX_AVX2 void max_elementwise_code_avx2(const float* u, const C* v, std::size_t n, float* out) {
+            std::size_t x = 0;
+            for (; x + 8 <= n; x += 8) {
+                __m256 r = widen_avx2(v + x);
+                _mm256_storeu_ps(out + x, u ? _mm256_max_ps(_mm256_loadu_ps(u + x), r) : r);
+            }
+            for (; x < n; ++x)
+                out[x] = u ? std::max(u[x], float(v[x])) : float(v[x]);
+        }
+
+        // Per-lane terms of the feature reductions, each symmetric in a and b
+        MINIMAX_AVX2 inline __m256 squared_difference_avx2(__m256 a, __m256 b) {
+            __m256 d = _mm256_sub_ps(a, b);
+            return _mm256_mul_ps(d, d);
+        }
+
+        MINIMAX_AVX2 inline __m256 absolute_difference_avx2(__m256 a, __m256 b) {
+            return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(a, b));
+        }
+
+        MINIMAX_AVX2 inline __m256 product_avx2(__m256 a, __m256 b) {
+            return _mm256_mul_ps(a, b);
+        }
+
+        // sum_k term(a[k], b[k]) for k < dim, over two accumulators
+        template <__m256 (*term)(__m256, __m256)>
+        MINIMAX_AVX2 float sum_avx2(const float* a, const float* b, std::size_t dim) {
+            __m256 s0 = _mm256_setzero_ps();
+            __m256 s1 = _mm256_setzero_ps();
+            std::size_t k = 0;
+            for (; k + 16 <= dim; k += 16) {
+                s0 = _mm256_add_ps(s0, term(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k)));
+                s1 = _mm256_add_ps(s1, term(_mm256_loadu_ps(a + k + 8), _mm256_loadu_ps(b + k + 8)));
+            }
+            const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            for (; k < dim; k += 8) {
+                // Lanes past dim load as zeros, whose terms are zero
+                int remaining = static_cast<int>(std::min<std::size_t>(dim - k, 8));
+                __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lane);
+                s0 = _mm256_add_ps(s0, term(_mm256_maskload_ps(a + k, mask), _mm256_maskload_ps(b + k, mask)));
+            }
+            float lanes[8];
+            _mm256_storeu_ps(lanes, _mm256_add_ps(s0, s1));
+            float sum = 0;
+            for (float l : lanes)
+                sum += l;
+            return sum;
+        }
+
+        MINIMAX_AVX2 float squared_euclidean_avx2(const float* a, const float* b, std::size_t dim) {
+            return sum_avx2<squared_difference_avx2>(a, b, dim);
+        }
+
+        MINIMAX_AVX2 float manhattan_avx2(const float* a, const float* b, std::size_t dim) {
+            return sum_avx2<absolute_difference_avx2>(a, b, dim);
+        }
+
+        MINIMAX_AVX2 float dot_avx2(const float* a, const float* b, std::size_t dim) {
+            return sum_avx2<product_avx2>(a, b, dim);
+        }
+
+        // The lanes of s summed in order
+        MINIMAX_AVX2 inline float hsum_avx2(__m256 s) {
+            float lanes[8];
+            _mm256_storeu_ps(lanes, s);
+            float sum = 0;
+            for (float l : lanes)
+                sum += l;
+            return sum;
+        }
+
+        // 4 rows by 2 columns of products at a time: each step loads 6 vectors for 8 products
+        MINIMAX_AVX2 void dot_block_avx2(const float* a, std::size_t rows, const float* b, std::size_t cols,
+                                         std::size_t dim, float* out, std::size_t ldo) {
+            std::size_t r = 0;
+            for (; r + 4 <= rows; r += 4) {
+                std::size_t c = 0;
+                for (; c + 2 <= cols; c += 2) {
+                    __m256 s[4][2];
+                    for (int i = 0; i < 4; ++i)
+                        for (int j = 0; j < 2; ++j)
+                            s[i][j] = _mm256_setzero_ps();
+                    for (std::size_t k = 0; k < dim; k += 8) {
+                        __m256 y[2] = {_mm256_loadu_ps(b + c*dim + k), _mm256_loadu_ps(b + (c + 1)*dim + k)};
+                        for (int i = 0; i < 4; ++i) {
+                            __m256 x = _mm256_loadu_ps(a + (r + i)*dim + k);
+                            for (int j = 0; j < 2; ++j)
+                                s[i][j] = _mm256_add_ps(s[i][j], _mm256_mul_ps(x, y[j]));
+                        }
+                    }
+                    for (int i = 0; i < 4; ++i)
+                        for (int j = 0; j < 2; ++j)
+                            out[(r + i)*ldo + c + j] = hsum_avx2(s[i][j]);
+                }
+                for (; c < cols; ++c)
+                    for (std::size_t i = r; i < r + 4; ++i)
+                        out[i*ldo + c] = dot_avx2(a + i*dim, b + c*dim, dim);
+            }
+            for (; r < rows; ++r)
+                for (std::size_t c = 0; c < cols; ++c)
+                    out[r*ldo + c] = dot_avx2(a + r*dim, b + c*dim, dim);
+        }
+
+        // Hardware popcount, over four independent counts to hide its latency
+        template <bool exclusive>
+        MINIMAX_POPCNT std::size_t popcount_popcnt(const std::uint64_t* a, const std::uint64_t* b, std::size_t words) {
+            std::uint64_t c[4] = {0, 0, 0, 0};
+            std::size_t k = 0;
+            for (; k + 4 <= words; k += 4)
+                for (int l = 0; l < 4; ++l)
+                    c[l] += _mm_popcnt_u64(exclusive ? a[k + l] ^ b[k + l] : a[k + l] & b[k + l]);
+            for (; k < words; ++k)
+                c[0] += _mm_popcnt_u64(exclusive ? a[k] ^ b[k] : a[k] & b[k]);
+            return static_cast<std::size_t>(c[0] + c[1] + c[2] + c[3]);
+        }
+
+        MINIMAX_POPCNT std::size_t popcount_xor_popcnt(const std::uint64_t* a, const std::uint64_t* b,
+                                                       std::size_t words) {
+            return popcount_popcnt<true>(a, b, words);
+        }
+
+        MINIMAX_POPCNT std::size_t popcount_and_popcnt(const std::uint64_t* a, const std::uint64_t* b,
+                                                       std::size_t words) {
+            return popcount_popcnt<false>(a, b, words);
+        }
+
+        // -- AVX-512
+
+        // lt(c, x) for 16 points (see: lt_gather_avx2)
+        MINIMAX_AVX512 inline __m512 lt_gather_avx512(const float* lt, __m512i c, __m512i x) {
+            const __m512i one = _mm512_set1_epi64(1);
+            __m512i hi = _mm512_max_epi32(c, x);
+            __m512i lo = _mm512_min_epi32(c, x);
+            __m512i h0 = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(hi));
+            __m512i h1 = _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(hi, 1));
+            __m512i l0 = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(lo));
+            __m512i l1 = _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(lo, 1));
+            __m512i o0 = _mm512_add_epi64(_mm512_srli_epi64(_mm512_mul_epu32(h0, _mm512_add_epi64(h0, one)), 1), l0);
+            __m512i o1 = _mm512_add_epi64(_mm512_srli_epi64(_mm512_mul_epu32(h1, _mm512_add_epi64(h1, one)), 1), l1);
+            __m256 g0 = _mm512_i64gather_ps(o0, lt, 4);
+            __m256 g1 = _mm512_i64gather_ps(o1, lt, 4);
+            return _mm512_insertf32x8(_mm512_castps256_ps512(g0), g1, 1);
+        }
+
+        MINIMAX_AVX512 void reduce_min_avx512(__m512 best, __m512i best_t, float& value, std::size_t& position) {
+            float values[16];
+            int positions[16];
+            _mm512_storeu_ps(values, best);
+            _mm512_storeu_si512(positions, best_t);
+            reduce_min(values, positions, 16, value, position);
+        }
+
+        MINIMAX_AVX512 void reduce_max_avx512(__m512 best, __m512i best_t, float& value, std::size_t& position) {
+            float values[16];
+            int positions[16];
+            _mm512_storeu_ps(values, best);
+            _mm512_storeu_si512(positions, best_t);
+            reduce_max(values, positions, 16, value, position);
+        }
+
+        MINIMAX_AVX512 float min_max_gather_avx512(const float* u, const float* v, const int* idx, std::size_t k,
+                                                   std::size_t& position) {
+            __m512 best = _mm512_set1_ps(inf);
+            __m512i best_t = _mm512_set1_epi32(-1);
+            __m512i t_vec = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            const __m512i step = _mm512_set1_epi32(16);
+            std::size_t t = 0;
+            for (; t + 16 <= k; t += 16) {
+                __m512i x = _mm512_loadu_si512(idx + t);
+                __m512 r = _mm512_max_ps(_mm512_i32gather_ps(x, u, 4), _mm512_i32gather_ps(x, v, 4));
+                __mmask16 less = _mm512_cmp_ps_mask(r, best, _CMP_LT_OQ);
+                best = _mm512_mask_mov_ps(best, less, r);
+                best_t = _mm512_mask_mov_epi32(best_t, less, t_vec);
+                t_vec = _mm512_add_epi32(t_vec, step);
+            }
+            float value = inf;
+            position = k;
+            reduce_min_avx512(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = std::max(u[idx[t]], v[idx[t]]);
+                if (r < value) {
+                    value = r;
+                    position = t;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX512 float min_max_gather_lt_avx512(const float* u, const float* lt, int c, const int* idx,
+                                                      std::size_t k, std::size_t& position) {
+            __m512 best = _mm512_set1_ps(inf);
+            __m512i best_t = _mm512_set1_epi32(-1);
+            __m512i t_vec = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            const __m512i step = _mm512_set1_epi32(16);
+            const __m512i c_vec = _mm512_set1_epi32(c);
+            std::size_t t = 0;
+            for (; t + 16 <= k; t += 16) {
+                __m512i x = _mm512_loadu_si512(idx + t);
+                __m512 r = _mm512_max_ps(_mm512_i32gather_ps(x, u, 4), lt_gather_avx512(lt, c_vec, x));
+                __mmask16 less = _mm512_cmp_ps_mask(r, best, _CMP_LT_OQ);
+                best = _mm512_mask_mov_ps(best, less, r);
+                best_t = _mm512_mask_mov_epi32(best_t, less, t_vec);
+                t_vec = _mm512_add_epi32(t_vec, step);
+            }
+            float value = inf;
+            position = k;
+            reduce_min_avx512(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = std::max(u[idx[t]], lt[lt_offset(c, idx[t])]);
+                if (r < value) {
+                    value = r;
+                    position = t;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX512 float max_gather_lt_avx512(const float* lt, int c, const int* idx, std::size_t k,
+                                                  float cutoff, std::size_t& position) {
+            __m512 best = _mm512_set1_ps(-inf);
+            __m512i best_t = _mm512_set1_epi32(-1);
+            __m512i t_vec = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            const __m512i step = _mm512_set1_epi32(16);
+            const __m512i c_vec = _mm512_set1_epi32(c);
+            const __m512 cut = _mm512_set1_ps(cutoff);
+            float value = -inf;
+            position = k;
+            std::size_t t = 0;
+            for (; t + 16 <= k; t += 16) {
+                __m512i x = _mm512_loadu_si512(idx + t);
+                __m512 r = lt_gather_avx512(lt, c_vec, x);
+                __mmask16 greater = _mm512_cmp_ps_mask(r, best, _CMP_GT_OQ);
+                best = _mm512_mask_mov_ps(best, greater, r);
+                best_t = _mm512_mask_mov_epi32(best_t, greater, t_vec);
+                t_vec = _mm512_add_epi32(t_vec, step);
+                // Abandon once any lane passes the cutoff
+                if (_mm512_cmp_ps_mask(r, cut, _CMP_GT_OQ)) {
+                    reduce_max_avx512(best, best_t, value, position);
+                    return value;
+                }
+            }
+            reduce_max_avx512(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = lt[lt_offset(c, idx[t])];
+                if (r > value) {
+                    value = r;
+                    position = t;
+                    if (value > cutoff)
+                        break;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX512 float max_gather_avx512(const float* v, const int* idx, std::size_t k, float cutoff,
+                                               std::size_t& position) {
+            __m512 best = _mm512_set1_ps(-inf);
+            __m512i best_t = _mm512_set1_epi32(-1);
+            __m512i t_vec = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            const __m512i step = _mm512_set1_epi32(16);
+            const __m512 cut = _mm512_set1_ps(cutoff);
+            float value = -inf;
+            position = k;
+            std::size_t t = 0;
+            for (; t + 16 <= k; t += 16) {
+                __m512i x = _mm512_loadu_si512(idx + t);
+                __m512 r = _mm512_i32gather_ps(x, v, 4);
+                __mmask16 greater = _mm512_cmp_ps_mask(r, best, _CMP_GT_OQ);
+                best = _mm512_mask_mov_ps(best, greater, r);
+                best_t = _mm512_mask_mov_epi32(best_t, greater, t_vec);
+                t_vec = _mm512_add_epi32(t_vec, step);
+                if (_mm512_cmp_ps_mask(r, cut, _CMP_GT_OQ)) {
+                    reduce_max_avx512(best, best_t, value, position);
+                    return value;
+                }
+            }
+            reduce_max_avx512(best, best_t, value, position);
+            for (; t < k; ++t) {
+                float r = v[idx[t]];
+                if (r > value) {
+                    value = r;
+                    position = t;
+                    if (value > cutoff)
+                        break;
+                }
+            }
+            return value;
+        }
+
+        MINIMAX_AVX512 void max_row_lt_avx512(const float* u, const float* lt, int c, std::size_t n, float* out) {
+            // Row c of the triangle holds x <= c contiguously
+            const float* row = lt + lt_offset(c, 0);
+            std::size_t contiguous = std::min(n, static_cast<std::size_t>(c) + 1);
+            std::size_t x = 0;
+            for (; x + 16 <= contiguous; x += 16) {
+                __m512 r = _mm512_loadu_ps(row + x);
+                _mm512_storeu_ps(out + x, u ? _mm512_max_ps(_mm512_loadu_ps(u + x), r) : r);
+            }
+            for (; x < contiguous; ++x)
+                out[x] = u ? std::max(u[x], row[x]) : row[x];
+
+            // Column c holds x > c, one row apart
+            const __m512i c_vec = _mm512_set1_epi32(c);
+            __m512i x_vec = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(x)),
+                                             _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+            const __m512i step = _mm512_set1_epi32(16);
+            for (; x + 16 <= n; x += 16) {
+                __m512 r = lt_gather_avx512(lt, c_vec, x_vec);
+                _mm512_storeu_ps(out + x, u ? _mm512_max_ps(_mm512_loadu_ps(u + x), r) : r);
+                x_vec = _mm512_add_epi32(x_vec, step);
+            }
+            for (; x < n; ++x) {
+                float r = lt[lt_offset(c, static_cast<int>(x))];
+                out[x] = u ? std::max(u[x], r) : r;
+            }
+        }
+
+        MINIMAX_AVX512 void max_elementwise_avx512(const float* u, const float* v, std::size_t n, float* out) {
+            std::size_t x = 0;
+            for (; x + 16 <= n; x += 16)
+                _mm512_storeu_ps(out + x, _mm512_max_ps(_mm512_loadu_ps(u + x), _mm512_loadu_ps(v + x)));
+            for (; x < n; ++x)
+                out[x] = std::max(u[x], v[x]);
+        }
+
+        MINIMAX_AVX512 inline __m512 squared_difference_avx512(__m512 a, __m512 b) {
+            __m512 d = _mm512_sub_ps(a, b);
+            return _mm512_mul_ps(d, d);
+        }
+
+        MINIMAX_AVX512 inline __m512 absolute_difference_avx512(__m512 a, __m512 b) {
+            return _mm512_abs_ps(_mm512_sub_ps(a, b));
+        }
+
+        MINIMAX_AVX512 inline __m512 product_avx512(__m512 a, __m512 b) {
+            return _mm512_mul_ps(a, b);
+        }
+
+        // As sum_avx2
+        template <__m512 (*term)(__m512, __m512)>
+        MINIMAX_AVX512 float sum_avx512(const float* a, const float* b, std::size_t dim) {
+            __m512 s0 = _mm512_setzero_ps();
+            __m512 s1 = _mm512_setzero_ps();
+            std::size_t k = 0;
+            for (; k + 32 <= dim; k += 32) {
+                s0 = _mm512_add_ps(s0, term(_mm512_loadu_ps(a + k), _mm512_loadu_ps(b + k)));
+                s1 = _mm512_add_ps(s1, term(_mm512_loadu_ps(a + k + 16), _mm512_loadu_ps(b + k + 16)));
+            }
+            for (; k < dim; k += 16) {
+                __mmask16 mask = dim - k >= 16 ? __mmask16(0xffff) : __mmask16((1u << (dim - k)) - 1);
+                s0 = _mm512_add_ps(s0, term(_mm512_maskz_loadu_ps(mask, a + k), _mm512_maskz_loadu_ps(mask, b + k)));
+            }
+            float lanes[16];
+            _mm512_storeu_ps(lanes, _mm512_add_ps(s0, s1));
+            float sum = 0;
+            for (float l : lanes)
+                sum += l;
+            return sum;
+        }
+
+        MINIMAX_AVX512 float squared_euclidean_avx512(const float* a, const float* b, std::size_t dim) {
+            return sum_avx512<squared_difference_avx512>(a, b, dim);
+        }
+
+        MINIMAX_AVX512 float manhattan_avx512(const float* a, const float* b, std::size_t dim) {
+            return sum_avx512<absolute_difference_avx512>(a, b, dim);
+        }
+
+        MINIMAX_AVX512 float dot_avx512(const float* a, const float* b, std::size_t dim) {
+            return sum_avx512<product_avx512>(a, b, dim);
+        }
+
+        MINIMAX_AVX512 inline float hsum_avx512(__m512 s) {
+            float lanes[16];
+            _mm512_storeu_ps(lanes, s);
+            float sum = 0;
+            for (float l : lanes)
+                sum += l;
+            return sum;
+        }
+
+        // As dot_block_avx2, 4 rows by 4 columns at a time: 8 loads for 16 products
+        MINIMAX_AVX512 void dot_block_avx512(const float* a, std::size_t rows, const float* b, std::size_t cols,
+                                             std::size_t dim, float* out, std::size_t ldo) {
+            std::size_t r = 0;
+            for (; r + 4 <= rows; r += 4) {
+                std::size_t c = 0;
+                for (; c + 4 <= cols; c += 4) {
+                    __m512 s[4][4];
+                    for (int i = 0; i < 4; ++i)
+                        for (int j = 0; j < 4; ++j)
+                            s[i][j] = _mm512_setzero_ps();
+                    for (std::size_t k = 0; k < dim; k += 16) {
+                        __m512 y[4];
+                        for (int j = 0; j < 4; ++j)
+                            y[j] = _mm512_loadu_ps(b + (c + j)*dim + k);
+                        for (int i = 0; i < 4; ++i) {
+                            __m512 x = _mm512_loadu_ps(a + (r + i)*dim + k);
+                            for (int j = 0; j < 4; ++j)
+                                s[i][j] = _mm512_add_ps(s[i][j], _mm512_mul_ps(x, y[j]));
+                        }
+                    }
+                    for (int i = 0; i < 4; ++i)
+                        for (int j = 0; j < 4; ++j)
+                            out[(r + i)*ldo + c + j] = hsum_avx512(s[i][j]);
+                }
+                for (; c < cols; ++c)
+                    for (std::size_t i = r; i < r + 4; ++i)
+                        out[i*ldo + c] = dot_avx512(a + i*dim, b + c*dim, dim);
+            }
+            for (; r < rows; ++r)
+                for (std::size_t c = 0; c < cols; ++c)
+                    out[r*ldo + c] = dot_avx512(a + r*dim, b + c*dim, dim);
+        }
+
+        // Popcounts of 8 words at a time (AVX512-VPOPCNTDQ), the tail with a masked load
+        template <bool exclusive>
+        MINIMAX_VPOPCNT std::size_t popcount_vpopcnt(const std::uint64_t* a, const std::uint64_t* b,
+                                                     std::size_t words) {
+            __m512i count = _mm512_setzero_si512();
+            for (std::size_t k = 0; k < words; k += 8) {
+                __mmask8 mask = words - k >= 8 ? __mmask8(0xff) : __mmask8((1u << (words - k)) - 1);
+                __m512i x = _mm512_maskz_loadu_epi64(mask, a + k);
+                __m512i y = _mm512_maskz_loadu_epi64(mask, b + k);
+                __m512i bits = exclusive ? _mm512_xor_si512(x, y) : _mm512_and_si512(x, y);
+                count = _mm512_add_epi64(count, _mm512_popcnt_epi64(bits));
+            }
+            std::uint64_t lanes[8];
+            _mm512_storeu_si512(lanes, count);
+            std::uint64_t total = 0;
+            for (std::uint64_t l : lanes)
+                total += l;
+            return static_cast<std::size_t>(total);
+        }
+
+        MINIMAX_VPOPCNT std::size_t popcount_xor_vpopcnt(const std::uint64_t* a, const std::uint64_t* b,
+                                                         std::size_t words) {
+            return popcount_vpopcnt<true>(a, b, words);
+        }
+
+        MINIMAX_VPOPCNT std::size_t popcount_and_vpopcnt(const std::uint64_t* a, const std::uint64_t* b,
+                                                         std::size_t words) {
+            return popcount_vpopcnt<false>(a, b, words);
+        }
+
+#endif
+
+        // -- Dispatch
+
+        struct Table {
+            const char* name;
+            float (*min_max_gather)(const float*, const float*, const int*, std::size_t, std::size_t&);
+            float (*min_max_gather_lt)(const float*, const float*, int, const int*, std::size_t, std::size_t&);
+            float (*max_gather_lt)(const float*, int, const int*, std::size_t, float, std::size_t&);
+            float (*max_gather)(const float*, const int*, std::size_t, float, std::size_t&);
+            void (*max_row_lt)(const float*, const float*, int, std::size_t, float*);
+            void (*max_elementwise)(const float*, const float*, std::size_t, float*);
+            // Narrow codes: only the contiguous widening is vectorized, gathers of codes are scalar
+            void (*max_elementwise_u16)(const float*, const std::uint16_t*, std::size_t, float*);
+            void (*max_elementwise_u8)(const float*, const std::uint8_t*, std::size_t, float*);
+            float (*squared_euclidean)(const float*, const float*, std::size_t);
+            float (*manhattan)(const float*, const float*, std::size_t);
+            float (*dot)(const float*, const float*, std::size_t);
+            void (*dot_block)(const float*, std::size_t, const float*, std::size_t, std::size_t, float*, std::size_t);
+            std::size_t (*popcount_xor)(const std::uint64_t*, const std::uint64_t*, std::size_t);
+            std::size_t (*popcount_and)(const std::uint64_t*, const std::uint64_t*, std::size_t);
+        };
+
+        const Table scalar_table = {"scalar", min_max_gather_scalar, min_max_gather_lt_scalar,
+                                    max_gather_lt_scalar, max_gather_scalar, max_row_lt_scalar,
+                                    max_elementwise_scalar, max_elementwise_scalar, max_elementwise_scalar,
+                                    squared_euclidean_scalar, manhattan_scalar, dot_scalar, dot_block_scalar,
+                                    popcount_xor_scalar, popcount_and_scalar};
+#ifdef MINIMAX_X86_KERNELS
+        const Table avx2_table = {"avx2", min_max_gather_avx2, min_max_gather_lt_avx2,
+                                  max_gather_lt_avx2, max_gather_avx2, max_row_lt_avx2,
+                                  max_elementwise_avx2, max_elementwise_code_avx2, max_elementwise_code_avx2,
+                                  squared_euclidean_avx2, manhattan_avx2, dot_avx2, dot_block_avx2,
+                                  popcount_xor_popcnt, popcount_and_popcnt};
+        const Table avx512_table = {"avx512", min_max_gather_avx512, min_max_gather_lt_avx512,
+                                    max_gather_lt_avx512, max_gather_avx512, max_row_lt_avx512,
+                                    max_elementwise_avx512, max_elementwise_code_avx2, max_elementwise_code_avx2,
+                                    squared_euclidean_avx512, manhattan_avx512, dot_avx512, dot_block_avx512,
+                                    popcount_xor_popcnt, popcount_and_popcnt};
+        // As avx512_table, with the popcounts of AVX512-VPOPCNTDQ
+        const Table avx512_vpopcnt_table = {"avx512", min_max_gather_avx512, min_max_gather_lt_avx512,
+                                            max_gather_lt_avx512, max_gather_avx512, max_row_lt_avx512,
+                                            max_elementwise_avx512, max_elementwise_code_avx2,
+                                            max_elementwise_code_avx2, squared_euclidean_avx512, manhattan_avx512,
+                                            dot_avx512, dot_block_avx512, popcount_xor_vpopcnt, popcount_and_vpopcnt};
+#endif
+
+        // The table for name if the host supports it, null otherwise
+        const Table* find_table(const char* name) {
+#ifdef MINIMAX_X86_KERNELS
+            __builtin_cpu_init();
+            bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+            bool avx512 = avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+            const Table* wide = __builtin_cpu_supports("avx512vpopcntdq") ? &avx512_vpopcnt_table : &avx512_table;
+            if (std::strcmp(name, "native") == 0)
+                return avx512 ? wide : (avx2 ? &avx2_table : &scalar_table);
+            if (std::strcmp(name, "avx512") == 0)
+                return avx512 ? wide : nullptr;
+            if (std::strcmp(name, "avx2") == 0)
+                return avx2 ? &avx2_table : nullptr;
+#else
+            if (std::strcmp(name, "native") == 0)
+                return &scalar_table;
+#endif
+            if (std::strcmp(name, "scalar") == 0)
+                return &scalar_table;
+            return nullptr;
+        }
+
+        const Table* active = find_table("native");
+
+        // Gathers are latency bound: below this many points the vector setup and the coarser
+        // early exit of max_gather_lt cost more than they save.
+        const std::size_t gather_cutoff = 32;
+
+        void max_elementwise_code(const float* u, const std::uint16_t* v, std::size_t n, float* out) {
+            active->max_elementwise_u16(u, v, n, out);
+        }
+
+        void max_elementwise_code(const float* u, const std::uint8_t* v, std::size_t n, float* out) {
+            active->max_elementwise_u8(u, v, n, out);
+        }
+
+    }
+
+    float min_max_gather(const float* u, const float* v, const int* idx, std::size_t k, std::size_t& position) {
+        if (k < gather_cutoff)
+            return min_max_gather_scalar(u, v, idx, k, position);
+        return active->min_max_gather(u, v, idx, k, position);
+    }
+
+    float min_max_gather_lt(const float* u, const float* lt, int c, const int* idx, std::size_t k,
+                            std::size_t& position) {
+        if (k < gather_cutoff)
+            return min_max_gather_lt_scalar(u, lt, c, idx, k, position);
+        return active->min_max_gather_lt(u, lt, c, idx, k, position);
+    }
+
+    float max_gather_lt(const float* lt, int c, const int* idx, std::size_t k, float cutoff, std::size_t& position) {
+        if (k < gather_cutoff)
+            return max_gather_lt_scalar(lt, c, idx, k, cutoff, position);
+        return active->max_gather_lt(lt, c, idx, k, cutoff, position);
+    }
+
+    float max_gather(const float* v, const int* idx, std::size_t k, float cutoff, std::size_t& position) {
+        if (k < gather_cutoff)
+            return max_gather_scalar(v, idx, k, cutoff, position);
+        return active->max_gather(v, idx, k, cutoff, position);
+    }
+
+    void max_row_lt(const float* u, const float* lt, int c, std::size_t n, float* out) {
+        active->max_row_lt(u, lt, c, n, out);
+    }
+
+    void max_elementwise(const float* u, const float* v, std::size_t n, float* out) {
+        active->max_elementwise(u, v, n, out);
+    }
+
+    float squared_euclidean(const float* a, const float* b, std::size_t dim) {
+        return active->squared_euclidean(a, b, dim);
+    }
+
+    float manhattan(const float* a, const float* b, std::size_t dim) {
+        return active->manhattan(a, b, dim);
+    }
+
+    float dot(const float* a, const float* b, std::size_t dim) {
+        return active->dot(a, b, dim);
+    }
+
+    void dot_block(const float* a, std::size_t rows, const float* b, std::size_t cols, std::size_t dim, float* out,
+                   std::size_t ldo) {
+        active->dot_block(a, rows, b, cols, dim, out, ldo);
+    }
+
+    std::size_t popcount_xor(const std::uint64_t* a, const std::uint64_t* b, std::size_t words) {
+        return active->popcount_xor(a, b, words);
+    }
+
+    std::size_t popcount_and(const std::uint64_t* a, const std::uint64_t* b, std::size_t words) {
+        return active->popcount_and(a, b, words);
+    }
+
+    // -- Narrow codes
+
+    template <class C>
+    float min_max_gather(const float* u, const C* v, const int* idx, std::size_t k, std::size_t& position) {
+        return min_max_gather_scalar(u, v, idx, k, position);
+    }
+
+    template <class C>
+    float min_max_gather_lt(const float* u, const C* lt, int c, const int* idx, std::size_t k, std::size_t& position) {
+        return min_max_gather_lt_scalar(u, lt, c, idx, k, position);
+    }
+
+    template <class C>
+    float max_gather_lt(const C* lt, int c, const int* idx, std::size_t k, float cutoff, std::size_t& position) {
+        return max_gather_lt_scalar(lt, c, idx, k, cutoff, position);
+    }
+
+    template <class C>
+    float max_gather(const C* v, const int* idx, std::size_t k, float cutoff, std::size_t& position) {
+        return max_gather_scalar(v, idx, k, cutoff, position);
+    }
+
+    template <class C>
+    void max_row_lt(const float* u, const C* lt, int c, std::size_t n, float* out) {
+        // Row c of the triangle holds x <= c contiguously, column c holds x > c one row apart
+        std::size_t contiguous = std::min(n, static_cast<std::size_t>(c) + 1);
+        max_elementwise_code(u, lt + lt_offset(c, 0), contiguous, out);
+        for (std::size_t x = contiguous; x < n; ++x) {
+            float r = lt[lt_offset(c, static_cast<int>(x))];
+            out[x] = u ? std::max(u[x], r) : r;
+        }
+    }
+
+    template <class C>
+    void max_elementwise(const float* u, const C* v, std::size_t n, float* out) {
+        max_elementwise_code(u, v, n, out);
+    }
+
+#define MINIMAX_CODE_KERNELS(C) \
+    template float min_max_gather<C>(const float*, const C*, const int*, std::size_t, std::size_t&); \
+    template float min_max_gather_lt<C>(const float*, const C*, int, const int*, std::size_t, std::size_t&); \
+    template float max_gather_lt<C>(const C*, int, const int*, std::size_t, float, std::size_t&); \
+    template float max_gather<C>(const C*, const int*, std::size_t, float, std::size_t&); \
+    template void max_row_lt<C>(const float*, const C*, int, std::size_t, float*); \
+    template void max_elementwise<C>(const float*, const C*, std::size_t, float*);
+
+    MINIMAX_CODE_KERNELS(std::uint16_t)
+    MINIMAX_CODE_KERNELS(std::uint8_t)
+#undef MINIMAX_CODE_KERNELS
+
+    // -- Tiled triangle (scalar: within a tile the accesses are cache hits, which matters more than width)
+
+    namespace {
+        const std::size_t tile_shift = LTMatrix<float>::tile_shift;
+        const std::size_t tile_mask = LTMatrix<float>::tile_size - 1;
+
+        inline std::size_t tiled_offset(int c, int x) {
+            return c >= x ? LTMatrix<float>::tiled_offset(c, x) : LTMatrix<float>::tiled_offset(x, c);
+        }
+    }
+
+    float max_gather_tiled(const float* lt, int c, const int* idx, std::size_t k, float cutoff,
+                           std::size_t& position) {
+        float best = -inf;
+        position = k;
+        for (std::size_t t = 0; t < k; ++t) {
+            float r = lt[tiled_offset(c, idx[t])];
+            if (r > best) {
+                best = r;
+                position = t;
+                if (best > cutoff)
+                    break;
+            }
+        }
+        return best;
+    }
+
+    float min_max_gather_tiled(const float* u, const float* lt, int c, const int* idx, std::size_t k,
+                               std::size_t& position) {
+        float best = inf;
+        position = k;
+        for (std::size_t t = 0; t < k; ++t) {
+            float r = std::max(u[idx[t]], lt[tiled_offset(c, idx[t])]);
+            if (r < best) {
+                best = r;
+                position = t;
+            }
+        }
+        return best;
+    }
+
+    void max_row_tiled(const float* u, const float* lt, int c, std::size_t n, float* out) {
+        // Row c of the tiles left of the diagonal holds x <= c, tile_size entries at a time
+        std::size_t C = static_cast<std::size_t>(c) >> tile_shift;
+        std::size_t within = static_cast<std::size_t>(c) & tile_mask;
+        std::size_t x = 0;
+        for (std::size_t J = 0; J <= C && x < n; ++J) {
+            const float* row = lt + (LTMatrix<float>::offset(C, J) << (2*tile_shift)) + (within << tile_shift);
+            std::size_t end = std::min(n, J == C ? static_cast<std::size_t>(c) + 1 : (J + 1) << tile_shift);
+            for (; x < end; ++x)
+                out[x] = u ? std::max(u[x], row[x & tile_mask]) : row[x & tile_mask];
+        }
+        // Column c of the tiles below holds x > c, one tile row apart
+        for (; x < n; ++x) {
+            float r = lt[tiled_offset(c, static_cast<int>(x))];
+            out[x] = u ? std::max(u[x], r) : r;
+        }
+    }
+
+    const char* get_isa() {
+        return active->name;
+    }
+
+    bool set_isa(const char* name) {
+        const Table* table = find_table(name);
+        if (table == nullptr)
+            return false;
+        active = table;
+        return true;
+    }
+
+}
+}
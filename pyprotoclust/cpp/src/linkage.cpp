@@ -1,17 +1,174 @@
 #include "linkage.h"
+#include "kernels.h"
+#include <algorithm>
 #include <limits>
 
 namespace minimax {
-    Linkage::Linkage(std::shared_ptr<LTMatrix<float> > full_distance_matrix) {
-        // full_distance_matrix has 2*n_elems-1 entries
-        this->n_elems = (full_distance_matrix->size()+1)/2;
+
+    namespace {
+        /**
+         *  Reductions over the distances from the point c, by the layout and storage type of d (see:
+         *  kernels). Layouts without kernels for the type read through LTMatrix::get.
+         **/
+
+        // out[x] = max(u[x], v[x]), or v[x] if u is null
+        void max_or_copy(const float* u, const float* v, std::size_t n, float* out) {
+            kernels::max_elementwise(u ? u : v, v, n, out);
+        }
+
+        template <class C>
+        void max_or_copy(const float* u, const C* v, std::size_t n, float* out) {
+            kernels::max_elementwise(u, v, n, out);
+        }
+
+        // The tiled kernels take float distances only
+        const float* tiled_data(const LTMatrix<float>& d) {
+            return d.layout() == MatrixLayout::tiled ? d.data() : nullptr;
+        }
+
+        template <class T>
+        const float* tiled_data(const LTMatrix<T>&) {
+            return nullptr;
+        }
+
+        // max_t d(c, members[t]), abandoned above cutoff (see: kernels::max_gather_lt)
+        template <class T>
+        float max_from(const LTMatrix<T>& d, int c, const std::vector<int>& members, float cutoff,
+                       std::size_t& position) {
+            if (const float* lt = tiled_data(d))
+                return kernels::max_gather_tiled(lt, c, members.data(), members.size(), cutoff, position);
+            switch (d.layout()) {
+                case MatrixLayout::packed:
+                    return kernels::max_gather_lt(d.data(), c, members.data(), members.size(), cutoff, position);
+                case MatrixLayout::square:
+                    return kernels::max_gather(d.row(c), members.data(), members.size(), cutoff, position);
+                default:
+                    break;
+            }
+            float best = -std::numeric_limits<float>::infinity();
+            position = members.size();
+            for (std::size_t t = 0; t < members.size(); ++t) {
+                float r = d.get(c, members[t]);
+                if (r > best) {
+                    best = r;
+                    position = t;
+                    if (best > cutoff)
+                        break;
+                }
+            }
+            return best;
+        }
+
+        // min_t max(u[members[t]], d(c, members[t])) (see: kernels::min_max_gather_lt)
+        template <class T>
+        float min_max_from(const float* u, const LTMatrix<T>& d, int c, const std::vector<int>& members,
+                           std::size_t& position) {
+            if (const float* lt = tiled_data(d))
+                return kernels::min_max_gather_tiled(u, lt, c, members.data(), members.size(), position);
+            switch (d.layout()) {
+                case MatrixLayout::packed:
+                    return kernels::min_max_gather_lt(u, d.data(), c, members.data(), members.size(), position);
+                case MatrixLayout::square:
+                    return kernels::min_max_gather(u, d.row(c), members.data(), members.size(), position);
+                default:
+                    break;
+            }
+            float best = std::numeric_limits<float>::infinity();
+            position = members.size();
+            for (std::size_t t = 0; t < members.size(); ++t) {
+                float r = std::max(u[members[t]], float(d.get(c, members[t])));
+                if (r < best) {
+                    best = r;
+                    position = t;
+                }
+            }
+            return best;
+        }
+
+        // out[x] = max(u[x], d(c, x)) for x < n, or d(c, x) if u is null (see: kernels::max_row_lt)
+        template <class T>
+        void max_row_from(const float* u, const LTMatrix<T>& d, int c, std::size_t n, float* out) {
+            if (const float* lt = tiled_data(d)) {
+                kernels::max_row_tiled(u, lt, c, n, out);
+                return;
+            }
+            switch (d.layout()) {
+                case MatrixLayout::packed:
+                    kernels::max_row_lt(u, d.data(), c, n, out);
+                    return;
+                case MatrixLayout::square:
+                    // The row is the eccentricity vector of the singleton {c}
+                    max_or_copy(u, d.row(c), n, out);
+                    return;
+                default:
+                    break;
+            }
+            for (std::size_t x = 0; x < n; ++x) {
+                float r = d.get(c, x);
+                out[x] = u ? std::max(u[x], r) : r;
+            }
+        }
+
+        /**
+         *  The same reductions over distances computed on demand (from FeatureVectors or BitVectors),
+         *  one kernel call per distance. Distances that cannot change the result are skipped. Overload
+         *  resolution prefers the LTMatrix versions above for stored distances.
+         **/
+
+        template <class V>
+        float max_from(const V& d, int c, const std::vector<int>& members, float cutoff,
+                       std::size_t& position) {
+            float best = -std::numeric_limits<float>::infinity();
+            position = members.size();
+            for (std::size_t t = 0; t < members.size(); ++t) {
+                float r = d.get(c, members[t]);
+                if (r > best) {
+                    best = r;
+                    position = t;
+                    if (best > cutoff)
+                        break;
+                }
+            }
+            return best;
+        }
+
+        template <class V>
+        float min_max_from(const float* u, const V& d, int c, const std::vector<int>& members,
+                           std::size_t& position) {
+            float best = std::numeric_limits<float>::infinity();
+            position = members.size();
+            for (std::size_t t = 0; t < members.size(); ++t) {
+                // max(u, d) >= u cannot improve on best
+                if (u[members[t]] >= best)
+                    continue;
+                float r = std::max(u[members[t]], d.get(c, members[t]));
+                if (r < best) {
+                    best = r;
+                    position = t;
+                }
+            }
+            return best;
+        }
+
+        template <class V>
+        void max_row_from(const float* u, const V& d, int c, std::size_t n, float* out) {
+            for (std::size_t x = 0; x < n; ++x) {
+                float r = d.get(c, x);
+                out[x] = u ? std::max(u[x], r) : r;
+            }
+        }
+    }
+
+    Linkage::Linkage(const PointDistances& distance_matrix) {
+        // distance_matrix has n_elems entries (the original points)
+        this->n_elems = static_cast<int>(distance_matrix.size());
 
         // Initialize index sets
         this->G.reserve(this->n_elems);
         this->H.reserve(this->n_elems);
 
         // Copy in this distance matrix
-        this->distance_matrix = full_distance_matrix;
+        this->distance_matrix = distance_matrix;
     }
 
     void Linkage::minimax_linkage() {
@@ -22,29 +179,129 @@ namespace minimax {
     }
 
     std::tuple<double, int> Linkage::minimax_linkage(const std::vector<int>& Gg, const std::vector<int>& Hh) const {
+        return this->minimax_linkage(Gg, Hh, -1, -1);
+    }
+
+    std::tuple<double, int> Linkage::minimax_linkage(const std::vector<int>& Gg, const std::vector<int>& Hh,
+                                                     int G_center, int H_center) const {
         int best_center = -1;
         double best_radius = std::numeric_limits<double>::max();
-        
-        std::vector<int> G_union_H;
-        G_union_H.reserve( Gg.size() + Hh.size() ); // preallocate memory
-        G_union_H.insert( G_union_H.end(), Gg.begin(), Gg.end() );
-        G_union_H.insert( G_union_H.end(), Hh.begin(), Hh.end() );
-
-        // Get the minimal of the max radii
-        for (int possible_center : G_union_H) {
-            double current_max = -1;
-            // Get the max radius
-            for (int elem : G_union_H){
-                auto r = this->distance_matrix->get(possible_center, elem);
-                if (current_max < r)
-                    current_max = r;
+        int witness = -1;
+
+        // The radius of any member is an upper bound on the minimax radius. Start from the best
+        // of the hints so that weak candidates are dropped from the first scan on.
+        for (int hint : {G_center, H_center}) {
+            if (hint >= 0)
+                best_radius = std::min(best_radius, this->bounded_radius(hint, Gg, Hh, best_radius, witness));
+        }
+
+        // Get the minimal of the max radii. Candidates are visited in the order of G then H and
+        // the first one to reach the minimum wins, as in an exhaustive scan.
+        for (const std::vector<int>* members : {&Gg, &Hh}) {
+            for (int possible_center : *members) {
+                double current_max = this->bounded_radius(possible_center, Gg, Hh, best_radius, witness);
+                if (current_max < best_radius || (current_max == best_radius && best_center == -1)) {
+                    best_radius = current_max;
+                    best_center = possible_center;
+                }
+            }
+        }
+        return std::make_tuple(this->distance_matrix.decode(best_radius), best_center);
+    }
+
+    double Linkage::bounded_radius(int center, const std::vector<int>& Gg, const std::vector<int>& Hh,
+                                   double cutoff, int& witness) const {
+        // The point that disqualified the previous candidate is likely far from this one too
+        if (witness >= 0) {
+            double r = this->distance_matrix.code(center, witness);
+            if (r > cutoff)
+                return r;
+        }
+
+        // Cutoffs are float distances or the initial double max
+        float float_cutoff = cutoff < std::numeric_limits<float>::max() ? static_cast<float>(cutoff)
+                                                                          : std::numeric_limits<float>::infinity();
+        double current_max = -1;
+        for (const std::vector<int>* members : {&Gg, &Hh}) {
+            std::size_t t;
+            float r = this->distance_matrix.visit([&](const auto& d) {
+                return max_from(d, center, *members, float_cutoff, t);
+            });
+            if (current_max < r) {
+                current_max = r;
+                // Abandon the candidate as soon as it cannot win
+                if (current_max > cutoff) {
+                    witness = (*members)[t];
+                    return current_max;
+                }
             }
+        }
+        return current_max;
+    }
+
+    std::tuple<double, int> Linkage::minimax_linkage(const std::vector<int>& Gg, const std::vector<float>& mGg,
+                                                     const std::vector<int>& Hh, const std::vector<float>& mHh) const {
+        int best_center = -1;
+        double best_radius = std::numeric_limits<double>::max();
+
+        // Same visiting order as the all-pairs linkage (G then H) so ties resolve identically
+        for (const std::vector<int>* members : {&Gg, &Hh}) {
+            std::size_t t;
+            double current_max = this->min_eccentricity(*members, Gg, mGg, Hh, mHh, t);
             if (current_max < best_radius) {
                 best_radius = current_max;
-                best_center = possible_center;
+                best_center = (*members)[t];
+            }
+        }
+        return std::make_tuple(this->distance_matrix.decode(best_radius), best_center);
+    }
+
+    float Linkage::min_eccentricity(const std::vector<int>& members,
+                                    const std::vector<int>& Gg, const std::vector<float>& mGg,
+                                    const std::vector<int>& Hh, const std::vector<float>& mHh,
+                                    std::size_t& position) const {
+        // Singletons gather their eccentricities from the distance matrix
+        if (!mGg.empty() && !mHh.empty())
+            return kernels::min_max_gather(mGg.data(), mHh.data(), members.data(), members.size(), position);
+        if (!mGg.empty())
+            return this->min_max_row(mGg.data(), Hh[0], members, position);
+        if (!mHh.empty())
+            return this->min_max_row(mHh.data(), Gg[0], members, position);
+
+        float best = std::numeric_limits<float>::infinity();
+        position = members.size();
+        for (std::size_t t = 0; t < members.size(); ++t) {
+            float r = std::max(this->eccentricity(Gg, mGg, members[t]), this->eccentricity(Hh, mHh, members[t]));
+            if (r < best) {
+                best = r;
+                position = t;
             }
         }
-        return std::make_tuple(best_radius, best_center);
+        return best;
+    }
+
+    void Linkage::merge_eccentricity(const std::vector<int>& Gg, const std::vector<float>& mGg,
+                                     const std::vector<int>& Hh, const std::vector<float>& mHh,
+                                     std::vector<float>& mGH) const {
+        mGH.resize(this->n_elems);
+        if (!mGg.empty() && !mHh.empty()) {
+            kernels::max_elementwise(mGg.data(), mHh.data(), this->n_elems, mGH.data());
+        } else if (!mGg.empty()) {
+            this->max_row(mGg.data(), Hh[0], mGH.data());
+        } else if (!mHh.empty()) {
+            this->max_row(mHh.data(), Gg[0], mGH.data());
+        } else {
+            this->max_row(nullptr, Gg[0], mGH.data());
+            this->max_row(mGH.data(), Hh[0], mGH.data());
+        }
+    }
+
+    float Linkage::min_max_row(const float* u, int c, const std::vector<int>& members, std::size_t& position) const {
+        return this->distance_matrix.visit([&](const auto& d) { return min_max_from(u, d, c, members, position); });
+    }
+
+    void Linkage::max_row(const float* u, int c, float* out) const {
+        this->distance_matrix.visit([&](const auto& d) { max_row_from(u, d, c, this->n_elems, out); });
     }
     
     void Linkage::add_to_G(int entry) {
@@ -1,40 +1,95 @@
 #include "ltmatrix.h"
+#include <algorithm>
+#include <cstdint>
 
 namespace minimax{
-    // Explicit instantiations as needed
+    // Explicit instantiations as needed (narrow types hold codes, see: Quantization)
     template class LTMatrix<float>;
+    template class LTMatrix<std::uint16_t>;
+    template class LTMatrix<std::uint8_t>;
 
     template <class T>
-    LTMatrix<T>::LTMatrix(int n){
+    LTMatrix<T>::LTMatrix(std::size_t n, MatrixLayout layout){
         this->s = n;
-        this->distance = std::vector<T>(n*(n+1)/2, 0);
+        this->l = layout;
+        this->distance = std::vector<T>(entries(n, layout), 0);
+        this->values = this->distance.data();
     }
 
     template <class T>
-    T& LTMatrix<T>::operator()(int i, int j)
+    LTMatrix<T>::LTMatrix(std::size_t n, MatrixLayout layout, std::shared_ptr<MappedFile> file){
+        this->s = n;
+        this->l = layout;
+        this->file = file;
+        this->values = static_cast<T*>(file->data());
+    }
+
+    template <class T>
+    LTMatrix<T>::LTMatrix(const LTMatrix<T>& other){
+        this->s = other.s;
+        this->l = other.l;
+        this->distance = std::vector<T>(other.values, other.values + entries(other.s, other.l));
+        this->values = this->distance.data();
+    }
+
+    template <class T>
+    LTMatrix<T>& LTMatrix<T>::operator=(const LTMatrix<T>& other){
+        if (this != &other)
+            *this = LTMatrix<T>(other);
+        return *this;
+    }
+
+    template <class T>
+    void LTMatrix<T>::copy_from(const LTMatrix<T>& other){
+        std::copy(other.values, other.values + entries(other.s, other.l), this->values);
+    }
+
+    template <class T>
+    std::size_t LTMatrix<T>::entries(std::size_t n, MatrixLayout layout){
+        switch (layout) {
+            case MatrixLayout::tiled: {
+                // Whole tiles, including the unused upper half of the diagonal tiles
+                std::size_t tiles = (n + tile_size - 1) >> tile_shift;
+                return offset(tiles, 0) << (2*tile_shift);
+            }
+            case MatrixLayout::square: return n*n;
+            case MatrixLayout::condensed: return n*(n-1)/2;
+            default: return n*(n+1)/2;
+        }
+    }
+
+    template <class T>
+    T& LTMatrix<T>::operator()(std::size_t i, std::size_t j)
     {
-        if (j <= i) {
-            return this->distance[i*(i+1)/2 + j];
+        if (j <= i || this->l == MatrixLayout::square) {
+            return this->values[this->index(i, j)];
         } else {
             return this->operator()(j,i);
         }
     }
-    
+
     template <class T>
-    void LTMatrix<T>::set(int i, int j, T dij) {
-        if (j <= i) {
-            this->distance[i*(i+1)/2 + j] = dij;
+    void LTMatrix<T>::set(std::size_t i, std::size_t j, T dij) {
+        if (this->l == MatrixLayout::square) {
+            this->values[i*this->s + j] = dij;
+            this->values[j*this->s + i] = dij;
+        } else if (this->l == MatrixLayout::condensed && i == j) {
+            return;
+        } else if (j <= i) {
+            this->values[this->index(i, j)] = dij;
         } else {
             this->set(j, i, dij);
         }
     }
 
     template <class T>
-    T LTMatrix<T>::get(int i, int j) const {
-        if (j <= i) {
-            return this->distance[i*(i+1)/2 + j];
+    T LTMatrix<T>::get(std::size_t i, std::size_t j) const {
+        if (j < i || this->l == MatrixLayout::square) {
+            return this->values[this->index(i, j)];
+        } else if (j == i) {
+            return this->l == MatrixLayout::condensed ? 0 : this->values[this->index(i, i)];
         } else {
             return this->get(j, i);
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,89 @@
+#include "mappedfile.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace minimax {
+
+    namespace {
+        std::runtime_error system_error(const std::string& what, const std::string& path) {
+            return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+        }
+    }
+
+    std::shared_ptr<MappedFile> MappedFile::temporary(const std::string& directory, std::size_t bytes) {
+        std::string pattern = directory + "/pyprotoclust-XXXXXX";
+        std::vector<char> path(pattern.begin(), pattern.end());
+        path.push_back('\0');
+        int fd = mkstemp(path.data());
+        if (fd == -1)
+            throw system_error("Cannot create a temporary file in", directory);
+        unlink(path.data());
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == -1) {
+            close(fd);
+            throw system_error("Cannot extend a temporary file in", directory);
+        }
+        return std::shared_ptr<MappedFile>(new MappedFile(fd, 0, bytes, true));
+    }
+
+    std::shared_ptr<MappedFile> MappedFile::open(const std::string& path, std::size_t offset, std::size_t bytes) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw system_error("Cannot open", path);
+        struct stat status;
+        if (fstat(fd, &status) == -1 || static_cast<std::size_t>(status.st_size) < offset + bytes) {
+            close(fd);
+            throw std::runtime_error("The file '" + path + "' is too short for " + std::to_string(bytes) +
+                                     " bytes from offset " + std::to_string(offset));
+        }
+        return std::shared_ptr<MappedFile>(new MappedFile(fd, offset, bytes, false));
+    }
+
+    MappedFile::MappedFile(int fd, std::size_t offset, std::size_t bytes, bool write) {
+        this->bytes = bytes;
+        this->write = write;
+        this->mapping = nullptr;
+        this->mapping_size = 0;
+        this->begin = nullptr;
+        if (bytes == 0) {
+            close(fd);
+            return;
+        }
+
+        std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        std::size_t start = offset - offset % page;
+        this->mapping_size = bytes + (offset - start);
+        void* mapping = mmap(nullptr, this->mapping_size, write ? PROT_READ | PROT_WRITE : PROT_READ,
+                             MAP_SHARED, fd, static_cast<off_t>(start));
+        int error = errno;
+        // The mapping keeps its own reference to the file
+        close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error(std::string("Cannot map a distance file: ") + std::strerror(error));
+        this->mapping = mapping;
+        this->begin = static_cast<char*>(mapping) + (offset - start);
+    }
+
+    MappedFile::~MappedFile() {
+        if (this->mapping)
+            munmap(this->mapping, this->mapping_size);
+    }
+
+    void MappedFile::advise(Access access) {
+        if (!this->mapping)
+            return;
+        int advice = MADV_NORMAL;
+        if (access == Access::sequential)
+            advice = MADV_SEQUENTIAL;
+        else if (access == Access::random)
+            advice = MADV_RANDOM;
+        // A hint only: failure leaves the default read-ahead
+        madvise(this->mapping, this->mapping_size, advice);
+    }
+
+}
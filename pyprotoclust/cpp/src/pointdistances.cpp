@@ -0,0 +1,155 @@
+#include "pointdistances.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace minimax {
+
+    namespace {
+        std::uint32_t float_bits(float f) {
+            std::uint32_t x;
+            std::memcpy(&x, &f, sizeof(x));
+            return x;
+        }
+
+        float bits_float(std::uint32_t x) {
+            float f;
+            std::memcpy(&f, &x, sizeof(f));
+            return f;
+        }
+
+        // Nearest half (ties to even) of a nonnegative float
+        std::uint16_t half_bits(float f) {
+            std::uint32_t x = float_bits(f);
+            if (x >= 0x7f800000)
+                return x > 0x7f800000 ? 0x7e00 : 0x7c00;
+            // 65520 and above round to infinity
+            if (x >= 0x477ff000)
+                return 0x7c00;
+            // Below 2^-14 the half is subnormal, a multiple of 2^-24
+            if (x < 0x38800000)
+                return static_cast<std::uint16_t>(std::nearbyint(f * 16777216.0f));
+            // Rebias the exponent (127 to 15) and round the mantissa from 23 to 10 bits
+            x -= (127 - 15) << 23;
+            return static_cast<std::uint16_t>((x + 0xfff + ((x >> 13) & 1)) >> 13);
+        }
+
+        float half_float(std::uint16_t h) {
+            std::uint32_t exponent = (h >> 10) & 0x1f;
+            std::uint32_t mantissa = h & 0x3ff;
+            if (exponent == 0)
+                return std::ldexp(static_cast<float>(mantissa), -24);
+            if (exponent == 0x1f)
+                return bits_float(0x7f800000 | (mantissa << 13));
+            return bits_float(((exponent + 127 - 15) << 23) | (mantissa << 13));
+        }
+
+        // Nearest bfloat16 (ties to even) of a nonnegative float
+        std::uint16_t bfloat16_bits(float f) {
+            std::uint32_t x = float_bits(f);
+            if (x > 0x7f800000)
+                return 0x7fc0;
+            return static_cast<std::uint16_t>((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+        }
+    }
+
+    float Quantization::encode(float distance) const {
+        if (this->type == DistanceType::float32)
+            return distance;
+        // Codes are monotone only over nonnegative distances (this also maps -0 and NaN to 0)
+        if (!(distance > 0))
+            distance = 0;
+        switch (this->type) {
+            case DistanceType::float16: return half_bits(distance);
+            case DistanceType::bfloat16: return bfloat16_bits(distance);
+            default: {
+                float top = this->type == DistanceType::uint16 ? 65535.0f : 255.0f;
+                float code = std::nearbyint((distance - this->offset) / this->scale);
+                return std::min(std::max(code, 0.0f), top);
+            }
+        }
+    }
+
+    float Quantization::decode(float code) const {
+        switch (this->type) {
+            case DistanceType::float16: return half_float(static_cast<std::uint16_t>(code));
+            case DistanceType::bfloat16: return bits_float(static_cast<std::uint32_t>(code) << 16);
+            case DistanceType::uint16:
+            case DistanceType::uint8: return this->offset + code * this->scale;
+            default: return code;
+        }
+    }
+
+    PointDistances::PointDistances(std::shared_ptr<LTMatrix<float> > matrix) {
+        this->f32 = matrix;
+    }
+
+    PointDistances::PointDistances(std::shared_ptr<LTMatrix<std::uint16_t> > matrix, Quantization quantization) {
+        this->u16 = matrix;
+        this->quantization = quantization;
+    }
+
+    PointDistances::PointDistances(std::shared_ptr<LTMatrix<std::uint8_t> > matrix, Quantization quantization) {
+        this->u8 = matrix;
+        this->quantization = quantization;
+    }
+
+    PointDistances::PointDistances(std::shared_ptr<FeatureVectors> features) {
+        this->points = features;
+    }
+
+    PointDistances::PointDistances(std::shared_ptr<BitVectors> bits) {
+        this->bits = bits;
+    }
+
+    float PointDistances::set(std::size_t i, std::size_t j, float distance) {
+        if (this->computed())
+            throw std::runtime_error("The distances are computed from the points' vectors and cannot be set");
+        if ((this->f32 && this->f32->read_only()) || (this->u16 && this->u16->read_only()) ||
+            (this->u8 && this->u8->read_only()))
+            throw std::runtime_error("The distances are mapped read-only from a file and cannot be set");
+        float code = this->quantization.encode(distance);
+        if (this->f32)
+            this->f32->set(i, j, code);
+        else if (this->u16)
+            this->u16->set(i, j, static_cast<std::uint16_t>(code));
+        else
+            this->u8->set(i, j, static_cast<std::uint8_t>(code));
+        return this->decode(code);
+    }
+
+    MatrixLayout PointDistances::layout() const {
+        if (this->f32)
+            return this->f32->layout();
+        if (this->u16)
+            return this->u16->layout();
+        if (this->u8)
+            return this->u8->layout();
+        return MatrixLayout::packed;
+    }
+
+    void PointDistances::advise(Access access) {
+        // Feature and bit vectors are in memory
+        if (this->computed())
+            return;
+        if (this->f32)
+            this->f32->advise(access);
+        else if (this->u16)
+            this->u16->advise(access);
+        else
+            this->u8->advise(access);
+    }
+
+    void PointDistances::copy_to(LTMatrix<float>& matrix) const {
+        if (this->f32 && this->f32->layout() == matrix.layout()) {
+            matrix.copy_from(*this->f32);
+            return;
+        }
+        std::size_t n = this->size();
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = 0; j < i; ++j)
+                matrix.set(i, j, this->decode(this->code(i, j)));
+    }
+
+}
@@ -1,26 +1,115 @@
 #include "protoclust.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 
 namespace minimax{
-    Protoclust::Protoclust(int n) {
-        this->n_elems = n;
-
-        // Full distance matrix (n_elems initial points and n_elems-1 joins).
-        this->full_distance_matrix = std::make_shared<LTMatrix<float> >(2*this->n_elems - 1);
-        // Inform chain and linkage function about the distance matrix created here.
-        this->chain = Chain(this->full_distance_matrix);
-        this->linkage = Linkage(this->full_distance_matrix);
+
+    namespace {
+        /**
+         *  Lower bound of the minimax radius of a union of k clusters, given the (bounds of the)
+         *  minimax distances between them in a k by k matrix. The center x of the union lies in some
+         *  part X, and for every other part Y the radius of X u Y is at most the eccentricity of x
+         *  within X u Y, so the radius of the union is at least min_X max_{Y != X} d(X, Y). The
+         *  bound needs no triangle inequality and grows with each distance, so bounds of bounds
+         *  remain bounds.
+         **/
+        float union_bound(const float* d, int k) {
+            float bound = std::numeric_limits<float>::max();
+            for (int x = 0; x < k; ++x) {
+                float eccentricity = 0;
+                for (int y = 0; y < k; ++y)
+                    if (y != x)
+                        eccentricity = std::max(eccentricity, d[x*k + y]);
+                bound = std::min(bound, eccentricity);
+            }
+            return bound;
+        }
+
+        /**
+         *  Access hint for the scans of a mapped matrix once loaded. Rows of square storage are
+         *  contiguous and benefit from read-ahead; the other layouts mix rows with column walks that
+         *  touch one entry per page, where read-ahead fills memory with pages that are not read.
+         **/
+        Access scan_access(MatrixLayout layout) {
+            return layout == MatrixLayout::square ? Access::normal : Access::random;
+        }
+    }
+
+    Protoclust::Protoclust(int n, LinkageEngine engine, MatrixLayout layout, const std::string& directory,
+                           Quantization quantization)
+        : n_elems(n), engine(engine), directory(directory) {
+        // Point distances for the linkage and slot distances for the chain (n_elems each).
+        switch (quantization.type) {
+            case DistanceType::float32:
+                this->distance_matrix = PointDistances(this->new_matrix<float>(layout));
+                break;
+            case DistanceType::uint8:
+                this->distance_matrix = PointDistances(this->new_matrix<std::uint8_t>(layout), quantization);
+                break;
+            default:
+                this->distance_matrix = PointDistances(this->new_matrix<std::uint16_t>(layout), quantization);
+        }
+        this->initialize(layout);
+    }
+
+    Protoclust::Protoclust(const float* features, int n, int dim, FeatureMetric metric, LinkageEngine engine,
+                           MatrixLayout layout, const std::string& directory)
+        : n_elems(n), engine(engine), directory(directory) {
+        // Only the slot distances are stored (see: load_computed_distances)
+        this->distance_matrix = PointDistances(std::make_shared<FeatureVectors>(features, n, dim, metric));
+        this->initialize(layout);
+    }
+
+    Protoclust::Protoclust(const std::uint8_t* bits, int n, int bytes, BitMetric metric, LinkageEngine engine,
+                           MatrixLayout layout, const std::string& directory)
+        : n_elems(n), engine(engine), directory(directory) {
+        this->distance_matrix = PointDistances(std::make_shared<BitVectors>(bits, n, bytes, metric));
+        this->initialize(layout);
+    }
+
+    Protoclust::Protoclust(const std::string& path, std::size_t offset, int n, LinkageEngine engine,
+                           const std::string& directory)
+        : n_elems(n), engine(engine), directory(directory) {
+        std::size_t entries = LTMatrix<float>::entries(n, MatrixLayout::condensed);
+        std::shared_ptr<MappedFile> file = MappedFile::open(path, offset, entries * sizeof(float));
+        this->distance_matrix = PointDistances(std::make_shared<LTMatrix<float> >(n, MatrixLayout::condensed, file));
+        this->initialize(MatrixLayout::condensed);
+
+        // The slot distances start as a straight copy of the file
+        this->distance_matrix.copy_to(*this->cluster_distance_matrix);
+    }
+
+    void Protoclust::initialize(MatrixLayout layout) {
+        // The chain scans rows of the slot distances: square storage serves those too, and condensed
+        // storage is copied from the point distances as is (see: the mapped constructor)
+        bool keep = layout == MatrixLayout::square || layout == MatrixLayout::condensed;
+        MatrixLayout slot_layout = keep ? layout : MatrixLayout::packed;
+        this->cluster_distance_matrix = this->new_matrix<float>(slot_layout);
+        // Both are filled in one pass next (see: set_condensed_distances, load_computed_distances)
+        this->distance_matrix.advise(Access::sequential);
+        this->cluster_distance_matrix->advise(Access::sequential);
+        // Inform chain and linkage function about the distance matrices created here.
+        this->chain = Chain(this->cluster_distance_matrix);
+        this->linkage = Linkage(this->distance_matrix);
         
-        // List of subsets of {0,1,...,n-1} (length = n + (n-1 merges))
-        this->cluster.resize(2*this->n_elems - 1);
+        // Members of the cluster in each slot, a subset of {0,1,...,n-1} (length = n slots)
+        this->cluster.resize(this->n_elems);
 
         // List of points in {0,1,...,n-1} (length = n + (n-1 merges))
         this->cluster_centers.resize(2*this->n_elems - 1);
 
-        // Initialize indices
+        // Singletons read their eccentricities from the distance matrix (length = n slots)
+        this->eccentricity.resize(this->n_elems);
+
+        // Initialize indices (slot i holds point i)
+        this->slot_cluster.resize(this->n_elems);
         for(int i = 0; i < this->n_elems; ++i){
             this->cluster[i] = std::vector<int>(1, i);
             this->cluster_centers[i] = i;
+            this->slot_cluster[i] = i;
         }
 
         // Linkage matrix (length = n-1 merges)
@@ -28,73 +117,425 @@ namespace minimax{
         this->Z_1.resize(this->n_elems - 1);
         this->Z_2.resize(this->n_elems - 1);
         this->Z_3.resize(this->n_elems - 1);
+        this->n_merges = this->n_elems - 1;
     }
 
-    Protoclust::Protoclust(const std::vector< std::vector<float>>& dm) : Protoclust(dm.size()) {
+    Protoclust::Protoclust(const std::vector< std::vector<float>>& dm, LinkageEngine engine, MatrixLayout layout)
+        : Protoclust(dm.size(), engine, layout) {
         // Load distances from dm
         for(unsigned int i = 0; i < dm.size(); ++i) {
             for(unsigned int j=0; j <= i; ++j) {
-                this->full_distance_matrix->set(i, j, dm[i][j]);
+                this->set_distance(i, j, dm[i][j]);
             }
         }
     }
 
     void Protoclust::set_distance(int i, int j, float dist) {
-        // i,j < n_elems        
-        this->full_distance_matrix->set(i,j,dist);
+        // i,j < n_elems (singleton clusters start out at the point distances)
+        // Singletons link at the distance that the stored code decodes to
+        this->cluster_distance_matrix->set(i, j, this->distance_matrix.set(i, j, dist));
+    }
+
+    void Protoclust::set_condensed_distances(const float* condensed) {
+        this->load_condensed(condensed);
+    }
+
+    void Protoclust::set_condensed_distances(const double* condensed) {
+        this->load_condensed(condensed);
+    }
+
+    template <class T>
+    void Protoclust::load_condensed(const T* condensed) {
+        // Read the condensed vector sequentially (row i holds j = i+1, ..., n-1)
+        std::size_t k = 0;
+        for(int i = 0; i < this->n_elems; ++i) {
+            for(int j = i + 1; j < this->n_elems; ++j, ++k) {
+                this->set_distance(i, j, static_cast<float>(condensed[k]));
+            }
+        }
+    }
+
+    void Protoclust::set_feature_distances(const float* features, int dim, FeatureMetric metric) {
+        FeatureVectors points(features, this->n_elems, dim, metric);
+        if (!this->pool)
+            this->pool = std::make_shared<ThreadPool>(this->num_threads);
+
+        // Row tile I holds the tiles J <= I of the triangle. Tiles write disjoint entries, and a
+        // tile of rows is finished before the next one so that its rows of the matrices stay hot.
+        std::size_t n = this->n_elems;
+        std::size_t tiles = (n + feature_tile - 1) / feature_tile;
+        auto row_tile = [&](std::size_t I) {
+            std::vector<float> block(feature_tile * feature_tile);
+            std::size_t i0 = I * feature_tile;
+            std::size_t i1 = std::min(n, i0 + feature_tile);
+            for (std::size_t J = 0; J <= I; ++J) {
+                std::size_t j0 = J * feature_tile;
+                std::size_t j1 = std::min(i1, j0 + feature_tile);
+                points.block(i0, i1, j0, j1, block.data(), feature_tile);
+                for (std::size_t i = i0; i < i1; ++i)
+                    for (std::size_t j = j0; j < std::min(j1, i); ++j)
+                        this->set_distance(i, j, block[(i - i0)*feature_tile + (j - j0)]);
+            }
+        };
+        auto cost = [&](std::size_t I) { return double(I + 1) * feature_tile * feature_tile * dim; };
+        this->pool->parallel_for(tiles, row_tile, cost, parallel_cutoff);
+    }
+
+    void Protoclust::load_computed_distances() {
+        // Rows of slots write disjoint entries, and row i computes i distances
+        LTMatrix<float>& d = *this->cluster_distance_matrix;
+        this->distance_matrix.visit([&](const auto& points) {
+            auto row = [&](std::size_t i) {
+                for (std::size_t j = 0; j < i; ++j)
+                    d.set(i, j, points.get(i, j));
+            };
+            auto cost = [&](std::size_t i) { return double(i); };
+            this->pool->parallel_for(this->n_elems, row, cost, parallel_cutoff);
+        });
+    }
+
+    template <class T>
+    std::shared_ptr<LTMatrix<T> > Protoclust::new_matrix(MatrixLayout layout) const {
+        if (this->directory.empty())
+            return std::make_shared<LTMatrix<T> >(this->n_elems, layout);
+        std::size_t bytes = LTMatrix<T>::entries(this->n_elems, layout) * sizeof(T);
+        return std::make_shared<LTMatrix<T> >(this->n_elems, layout, MappedFile::temporary(this->directory, bytes));
+    }
+
+    void Protoclust::set_num_threads(int num_threads) {
+        // Restarted on the next merge with the new size
+        this->num_threads = num_threads;
+        this->pool.reset();
+    }
+
+    void Protoclust::set_lazy(bool lazy) {
+        this->lazy = lazy;
+    }
+
+    void Protoclust::set_metric(bool metric) {
+        this->metric = metric;
     }
 
     void Protoclust::compute() {
+        this->compute(nullptr, nullptr, 1);
+    }
+
+    bool Protoclust::compute(ProgressCallback callback, void* data, int interval) {
         // n.b. all members are initialized according to n_elems
-        // n_elems-1 merges must occur 
-        for(int i=0; i < this->n_elems - 1; ++i) {
-            // allow this loop to occur outside this code (e.g. for status bars)
-            this->compute_index(i);
+        // n_elems-1 merges occur, fewer with a stop criterion (see: set_max_radius)
+        int n_merges = std::max(this->n_elems - this->min_clusters, 0);
+        this->ceiling = this->max_radius;
+        interval = std::max(interval, 1);
+        int next_report = interval;
+        int i = 0;
+        while (i < n_merges && this->chain.can_grow()) {
+            // Rounds run to completion, so report size stays independent of round size: each
+            // multiple of interval a round passed is reported after it, as does the final merge
+            i += this->compute_round(i, n_merges - i);
+            if (callback == nullptr)
+                continue;
+            for (; next_report < i; next_report += interval)
+                if (!callback(data, next_report))
+                    return false;
+            bool done = i == n_merges || !this->chain.can_grow();
+            if (next_report == i || done) {
+                if (!callback(data, i))
+                    return false;
+                if (next_report == i)
+                    next_report += interval;
+            }
+        }
+
+        // The chains merge out of order, so merges higher than some of those left may have been
+        // made. Every merge below the highest so far is made too, retiring the chains that end
+        // at or above it; the merges within the count are then the lowest of the clustering.
+        if (i == n_merges && i > 0 && this->chain.can_grow()) {
+            float highest = *std::max_element(this->Z_2.begin(), this->Z_2.begin() + i);
+            this->ceiling = std::min(this->ceiling, std::nextafter(highest, -std::numeric_limits<float>::infinity()));
+            while (this->chain.can_grow())
+                i += this->compute_round(i, this->n_elems - 1 - i);
         }
+        this->truncate(i, n_merges);
+        return true;
     }
 
     void Protoclust::compute_index(const int i) {
-            this->chain.grow_chain();
-            int rnn1 = this->chain.chain_end_2();
-            int rnn2 = this->chain.chain_end_1();
-
-            // Label the clusters
-            std::vector<int> G1 = this->cluster[rnn1];
-            std::vector<int> G2 = this->cluster[rnn2];
-            
-            // Construct merged cluster
-            // Resize (not reserve) initializes elements.
-            int G1G2_size = G1.size() + G2.size();
-            this->cluster[this->n_elems + i].resize(G1G2_size);
-            std::merge(G1.begin(), G1.end(), G2.begin(), G2.end(), 
-                       this->cluster[this->n_elems + i].begin());
-
-            // Compute the minimax distances for the 
-            //   new G1, G2 using all underlying points
-            std::tuple<double, int> G1_G2_res = this->linkage.minimax_linkage(G1, G2);
-            double G1G2_distance = std::get<0>(G1_G2_res);
-            this->cluster_centers[this->n_elems + i] = std::get<1>(G1_G2_res);
-
-            // Update the linkage matrix
-            this->update_Z(i, rnn1, rnn2, G1G2_distance, G1G2_size);
-
-            // Update cluster distances for (unmerged) available indices
-            // This loop can be run in parallel.
-            #pragma omp parallel for
-            for(unsigned int ia=0; ia <  this->chain.get_available_indicies().size(); ++ia) {
-                int a = this->chain.get_available_indicies()[ia];
-                if (a != rnn1 && a != rnn2) {
-                    std::tuple<double, int> result = this->linkage.minimax_linkage(cluster[this->n_elems + i], cluster[a]);
-                    double distance = std::get<0>(result);
-                    this->full_distance_matrix->set(a, this->n_elems+i, distance);
+        this->compute_round(i, 1);
+    }
+
+    int Protoclust::compute_round(const int i, const int max_merges) {
+        if (!this->pool)
+            this->pool = std::make_shared<ThreadPool>(this->num_threads);
+        if (i == 0 && this->distance_matrix.computed())
+            this->load_computed_distances();
+
+        // Copies of this object share nothing with the chain, so the evaluator is bound here
+        if (this->lazy)
+            this->chain.set_evaluator([this](int a, int b) { return float(this->slot_linkage(a, b)); });
+        if (this->lazy && this->metric && !this->diameter_matrix) {
+            // The diameter of the union of two singletons is their distance, as in the slot distances
+            this->diameter_matrix = this->new_matrix<float>(this->cluster_distance_matrix->layout());
+            this->diameter_matrix->copy_from(*this->cluster_distance_matrix);
+            this->chain.set_upper_bounds(this->diameter_matrix);
+        }
+        if (i == 0) {
+            this->distance_matrix.advise(scan_access(this->distance_matrix.layout()));
+            for (auto matrix : {this->cluster_distance_matrix, this->diameter_matrix})
+                if (matrix)
+                    matrix->advise(scan_access(matrix->layout()));
+        }
+
+        // The chain finds one recurrent pair and a sweep of the neighbor cache the others
+        this->chain.grow_chain();
+        std::vector<std::pair<int, int> > pairs;
+        this->chain.recurrent_pairs(pairs, max_merges, sweep_rescans, this->ceiling);
+        if (pairs.empty()) {
+            this->chain.retire_chain();
+            return 0;
+        }
+
+        // The pairs are disjoint, so their linkages run side by side (merge i+p is pair p)
+        auto merge = [&](std::size_t p) {
+            this->merge_pair(i + p, pairs[p].first, pairs[p].second);
+        };
+        auto merge_cost = [&](std::size_t p) {
+            double points = this->cluster[pairs[p].first].size() + this->cluster[pairs[p].second].size();
+            return this->engine == LinkageEngine::eccentricity ? double(this->n_elems) : points * points;
+        };
+        this->pool->parallel_for(pairs.size(), merge, merge_cost, parallel_cutoff);
+
+        // Each merged cluster is recycled into the lower slot of its pair
+        std::vector<int> merged(pairs.size());
+        for (std::size_t p = 0; p < pairs.size(); ++p)
+            merged[p] = std::min(pairs[p].first, pairs[p].second);
+        if (this->lazy)
+            this->bound_distances(i, pairs);
+        else
+            this->update_distances(i, merged);
+
+        // Update available indices by removing the merged indices 
+        //  and adding back the recycled slots
+        this->chain.merge_indicies(pairs, merged);
+        return pairs.size();
+    }
+
+    void Protoclust::merge_pair(const int i, const int rnn1, const int rnn2) {
+        // Slots of the recurrent nearest neighbors; the merged cluster reuses the lower slot
+        int merged = std::min(rnn1, rnn2);
+        int retired = std::max(rnn1, rnn2);
+
+        // Label the clusters (read in place, the slots are only rewritten after the linkage)
+        const std::vector<int>& G1 = this->cluster[rnn1];
+        const std::vector<int>& G2 = this->cluster[rnn2];
+        int G1G2_size = G1.size() + G2.size();
+
+        // Compute the minimax distances for the 
+        //   new G1, G2 using all underlying points
+        std::tuple<double, int> G1_G2_res;
+        if (this->engine == LinkageEngine::eccentricity) {
+            // The merged vector replaces both parents, which are never linked again
+            std::vector<float> m12;
+            this->linkage.merge_eccentricity(G1, this->eccentricity[rnn1], G2, this->eccentricity[rnn2], m12);
+            G1_G2_res = this->linkage.minimax_linkage(G1, m12, G2, m12);
+            this->eccentricity[merged].swap(m12);
+            std::vector<float>().swap(this->eccentricity[retired]);
+        } else {
+            G1_G2_res = this->linkage.minimax_linkage(G1, G2, this->cluster_centers[this->slot_cluster[rnn1]],
+                                                      this->cluster_centers[this->slot_cluster[rnn2]]);
+        }
+
+        // Construct the merged cluster in the recycled slot: the larger member list absorbs the
+        // smaller one, so each point is moved O(log n) times over the run, and the retired
+        // slot's storage is released.
+        std::vector<int> G12_members;
+        bool G1_larger = G1.size() >= G2.size();
+        G12_members.swap(this->cluster[G1_larger ? rnn1 : rnn2]);
+        std::vector<int>& smaller = this->cluster[G1_larger ? rnn2 : rnn1];
+        G12_members.insert(G12_members.end(), smaller.begin(), smaller.end());
+        std::vector<int>().swap(smaller);
+        this->cluster[merged].swap(G12_members);
+        double G1G2_distance = std::get<0>(G1_G2_res);
+        this->cluster_centers[this->n_elems + i] = std::get<1>(G1_G2_res);
+
+        // Update the linkage matrix
+        this->update_Z(i, this->slot_cluster[rnn1], this->slot_cluster[rnn2], G1G2_distance, G1G2_size);
+        this->slot_cluster[merged] = this->n_elems + i;
+        this->slot_cluster[retired] = -1;
+    }
+
+    void Protoclust::update_distances(const int i, const std::vector<int>& merged) {
+        // Update cluster distances between each merged slot and the other available slots in one
+        // pass on the worker pool, weighting each update by the number of points the linkage
+        // visits. Retired slots are skipped and a pair of merged slots is linked once.
+        const std::vector<int>& available = this->chain.get_available_indicies();
+        std::size_t n_available = available.size();
+        auto update = [&](std::size_t k) {
+            int m = merged[k / n_available];
+            int a = available[k % n_available];
+            // Slots merged in this round hold clusters from n_elems + i on
+            if (a == m || this->slot_cluster[a] == -1 || (this->slot_cluster[a] >= this->n_elems + i && a > m))
+                return;
+            this->cluster_distance_matrix->set(a, m, this->slot_linkage(a, m));
+        };
+        auto cost = [&](std::size_t k) {
+            // Eccentricity linkages scan both member lists, all-pairs linkages their product
+            double points = this->cluster[merged[k / n_available]].size() +
+                            this->cluster[available[k % n_available]].size();
+            return this->engine == LinkageEngine::eccentricity ? points : points * points;
+        };
+        this->pool->parallel_for(merged.size() * n_available, update, cost, parallel_cutoff);
+    }
+
+    void Protoclust::bound_distances(const int i, const std::vector<std::pair<int, int> >& pairs) {
+        // Bound each distance to a merged cluster from the distances between its parts (see:
+        // union_bound), read before the merged slot overwrites them. Distances between two clusters
+        // merged in this round are bounded separately, from the four parts involved. For metric
+        // distances, half the diameter of the union is a second lower bound (see: set_metric). The
+        // diameter of each merged pair stays readable, as only the entries of the merged slots change.
+        LTMatrix<float>& d = *this->cluster_distance_matrix;
+        for (std::size_t p = 0; p < pairs.size(); ++p) {
+            int G = pairs[p].first;
+            int H = pairs[p].second;
+            float h = this->Z_2[i + p];
+            for (auto a : this->chain.get_available_indicies()) {
+                if (this->slot_cluster[a] == -1 || this->slot_cluster[a] >= this->n_elems + i)
+                    continue;
+                float parts[3][3] = {{0, h, d(G, a)},
+                                     {h, 0, d(H, a)},
+                                     {d(G, a), d(H, a), 0}};
+                float bound = union_bound(&parts[0][0], 3);
+                if (this->diameter_matrix) {
+                    // The diameter of a union of three clusters is the largest of their pairwise unions
+                    LTMatrix<float>& u = *this->diameter_matrix;
+                    float diameter = std::max(std::max(u(G, a), u(H, a)), u(G, H));
+                    u.set(a, std::min(G, H), diameter);
+                    bound = std::max(bound, diameter / 2);
                 }
+                this->chain.set_bound(a, std::min(G, H), bound);
             }
+            for (std::size_t q = 0; q < p; ++q) {
+                int G2 = pairs[q].first;
+                int H2 = pairs[q].second;
+                float h2 = this->Z_2[i + q];
+                float parts[4][4] = {{0, h, d(G, G2), d(G, H2)},
+                                     {h, 0, d(H, G2), d(H, H2)},
+                                     {d(G, G2), d(H, G2), 0, h2},
+                                     {d(G, H2), d(H, H2), h2, 0}};
+                float bound = union_bound(&parts[0][0], 4);
+                if (this->diameter_matrix) {
+                    LTMatrix<float>& u = *this->diameter_matrix;
+                    float diameter = std::max(std::max(u(G, G2), u(G, H2)), std::max(u(H, G2), u(H, H2)));
+                    diameter = std::max(diameter, std::max(u(G, H), u(G2, H2)));
+                    u.set(std::min(G, H), std::min(G2, H2), diameter);
+                    bound = std::max(bound, diameter / 2);
+                }
+                this->chain.set_bound(std::min(G, H), std::min(G2, H2), bound);
+            }
+        }
+    }
+
+    double Protoclust::slot_linkage(const int a, const int b) {
+        std::tuple<double, int> result;
+        const std::vector<int>& Ga = this->cluster[a];
+        const std::vector<int>& Gb = this->cluster[b];
+        if (this->engine == LinkageEngine::eccentricity)
+            result = this->linkage.minimax_linkage(Ga, this->eccentricity[a], Gb, this->eccentricity[b]);
+        else
+            result = this->linkage.minimax_linkage(Ga, Gb, this->cluster_centers[this->slot_cluster[a]],
+                                                   this->cluster_centers[this->slot_cluster[b]]);
+        return std::get<0>(result);
+    }
+
+    void Protoclust::truncate(int merges, int limit) {
+        int n = this->n_elems;
+        if (merges > limit) {
+            // A cluster is never lower than its parts, so a stable sort by height keeps each merge
+            // after the merges of its parts, and the limit lowest merges form a clustering
+            std::vector<int> order(merges);
+            for (int r = 0; r < merges; ++r)
+                order[r] = r;
+            std::stable_sort(order.begin(), order.end(), [this](int r1, int r2) {
+                return this->Z_2[r1] < this->Z_2[r2];
+            });
+            std::vector<int> rank(merges);
+            for (int r = 0; r < merges; ++r)
+                rank[order[r]] = r;
+            auto renumber = [&](int c) { return c < n ? c : n + rank[c - n]; };
+
+            std::vector<int> Z_0(this->Z_0), Z_1(this->Z_1), Z_3(this->Z_3), centers(this->cluster_centers);
+            std::vector<double> Z_2(this->Z_2);
+            for (int r = 0; r < limit; ++r) {
+                int o = order[r];
+                this->update_Z(r, renumber(Z_0[o]), renumber(Z_1[o]), Z_2[o], Z_3[o]);
+                this->cluster_centers[n + r] = centers[n + o];
+            }
+            merges = limit;
+        }
+        this->n_merges = merges;
+
+        // Each cluster belongs to the cluster of the merge that takes it in, if any: the merges
+        // are visited from the last so that this cluster is known before its parts
+        std::vector<int> root(n + merges);
+        for (int c = 0; c < n + merges; ++c)
+            root[c] = c;
+        for (int r = merges - 1; r >= 0; --r) {
+            root[this->Z_0[r]] = root[n + r];
+            root[this->Z_1[r]] = root[n + r];
+        }
+        this->labels.resize(n);
+        this->label(root, this->labels.data(), this->prototypes);
+    }
+
+    void Protoclust::cut(const double* thresholds, int n_thresholds, int* labels,
+                         std::vector< std::vector<int>>& prototypes) {
+        int n = this->n_elems;
+        int m = this->n_merges;
+        std::size_t T = n_thresholds;
+        if (!this->pool)
+            this->pool = std::make_shared<ThreadPool>(this->num_threads);
 
-            // Update available indices by removing the merged indices 
-            //  and adding the new index by its iteration count
-            chain.merge_indicies(rnn1, rnn2, i);
-            // Remove the RNN pair from the end of the chain
-            chain.trim_chain();
+        // The merge that takes in each cluster, if any, comes after the merges of its parts
+        std::vector<int> parent(n + m, -1);
+        for (int r = 0; r < m; ++r) {
+            parent[this->Z_0[r]] = n + r;
+            parent[this->Z_1[r]] = n + r;
+        }
+
+        // Each threshold labels its own column; the columns are interleaved into rows after
+        prototypes.assign(T, std::vector<int>());
+        std::vector<int> columns(T * n);
+        auto cut_at = [&](std::size_t t) {
+            // From the last merge down, a cluster belongs to the cluster of its parent if the
+            // parent is within the threshold (and so is known by then), otherwise to itself
+            std::vector<int> root(n + m);
+            for (int c = n + m - 1; c >= 0; --c) {
+                int p = parent[c];
+                root[c] = p != -1 && this->Z_2[p - n] <= thresholds[t] ? root[p] : c;
+            }
+            this->label(root, columns.data() + t * n, prototypes[t]);
+        };
+        auto cut_cost = [&](std::size_t) { return double(n + m); };
+        this->pool->parallel_for(T, cut_at, cut_cost, parallel_cutoff);
+
+        auto interleave = [&](std::size_t i) {
+            for (std::size_t t = 0; t < T; ++t)
+                labels[i * T + t] = columns[t * n + i];
+        };
+        auto interleave_cost = [&](std::size_t) { return double(T); };
+        this->pool->parallel_for(n, interleave, interleave_cost, parallel_cutoff);
+    }
+
+    void Protoclust::label(const std::vector<int>& root, int* labels, std::vector<int>& prototypes) const {
+        std::vector<int> number(root.size(), -1);
+        prototypes.clear();
+        for (int p = 0; p < this->n_elems; ++p) {
+            int c = root[p];
+            if (number[c] == -1) {
+                number[c] = prototypes.size();
+                prototypes.push_back(this->cluster_centers[c]);
+            }
+            labels[p] = number[c];
+        }
     }
 
     void Protoclust::update_Z(int i, int i0, int i1, double i2, int i3) {
@@ -0,0 +1,147 @@
+#include "threadpool.h"
+#include <algorithm>
+
+namespace minimax {
+
+    ThreadPool::ThreadPool(int num_threads) {
+        if (num_threads <= 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        this->generation = 0;
+        this->stop = false;
+        this->body = nullptr;
+        this->pending = 0;
+        this->failed = false;
+
+        for (int i = 0; i < num_threads; ++i)
+            this->queues.emplace_back(new Queue());
+        // The calling thread is participant 0
+        for (int i = 1; i < num_threads; ++i)
+            this->workers.emplace_back(&ThreadPool::worker_main, this, i);
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stop = true;
+        }
+        this->wake.notify_all();
+        for (auto& worker : this->workers)
+            worker.join();
+    }
+
+    void ThreadPool::parallel_for(std::size_t n, const std::function<void(std::size_t)>& body,
+                                  const std::function<double(std::size_t)>& weight, double serial_cutoff) {
+        std::vector<double> weights(n);
+        double total = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            weights[k] = weight(k);
+            total += weights[k];
+        }
+
+        int participants = this->size();
+        if (participants == 1 || total < serial_cutoff) {
+            for (std::size_t k = 0; k < n; ++k)
+                body(k);
+            return;
+        }
+
+        // Cut [0, n) into consecutive ranges of about total/(4 participants) weight, so that a few
+        // heavy entries end up in ranges of their own and stealing can even out the rest.
+        std::vector<Range> ranges;
+        double target = total / (4.0 * participants);
+        std::size_t begin = 0;
+        double accumulated = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            accumulated += weights[k];
+            if (accumulated >= target || k + 1 == n) {
+                ranges.emplace_back(begin, k + 1);
+                begin = k + 1;
+                accumulated = 0;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->body = &body;
+            this->pending = ranges.size();
+        }
+        for (std::size_t r = 0; r < ranges.size(); ++r) {
+            Queue& queue = *this->queues[r % participants];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.ranges.push_back(ranges[r]);
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            ++this->generation;
+        }
+        this->wake.notify_all();
+
+        this->work(0);
+
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->done.wait(guard, [this] { return this->pending == 0; });
+        if (this->failed) {
+            std::exception_ptr error = this->error;
+            this->error = nullptr;
+            this->failed = false;
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool ThreadPool::pop(int self, Range& range) {
+        int participants = this->size();
+        for (int i = 0; i < participants; ++i) {
+            int victim = (self + i) % participants;
+            Queue& queue = *this->queues[victim];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.ranges.empty())
+                continue;
+            if (victim == self) {
+                range = queue.ranges.front();
+                queue.ranges.pop_front();
+            } else {
+                range = queue.ranges.back();
+                queue.ranges.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void ThreadPool::work(int self) {
+        Range range;
+        while (this->pop(self, range)) {
+            // After a failure the remaining ranges are only counted off
+            try {
+                for (std::size_t k = range.first; k < range.second && !this->failed; ++k)
+                    (*this->body)(k);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(this->lock);
+                if (!this->failed) {
+                    this->error = std::current_exception();
+                    this->failed = true;
+                }
+            }
+            if (this->pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->done.notify_all();
+            }
+        }
+    }
+
+    void ThreadPool::worker_main(int self) {
+        std::size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(this->lock);
+                this->wake.wait(guard, [&] { return this->stop || this->generation != seen; });
+                if (this->stop)
+                    return;
+                seen = this->generation;
+            }
+            this->work(self);
+        }
+    }
+
+}
@@ -1,29 +1,109 @@
 from pyprotoclust.c_protoclust import CyProtoclust
 from tqdm import tqdm_notebook, tqdm
+from math import sqrt
+import mmap as _mmap
+import tempfile
 
 
-def progress(iterable, verbose, notebook):
+def progress(total, verbose, notebook):
     if verbose:
         try:
             if notebook:
-                return tqdm_notebook(iterable)
+                return tqdm_notebook(total=total)
             else:
-                return tqdm(iterable)
+                return tqdm(total=total)
         except NameError:
-            return iterable
+            return None
     else:
-        return iterable
+        return None
 
 
-def protoclust(distance_matrix, verbose=False, notebook=False):
+def condensed_size(m):
+    """
+    The number of points n described by a condensed distance vector of length m = n*(n-1)/2.
+    """
+    n = int(round((1 + sqrt(1 + 8*m))/2))
+    if n*(n-1)//2 != m:
+        raise ValueError('A condensed distance vector of length {} does not describe a square matrix.'.format(m))
+    return n
+
+
+def mapped_file(array):
+    """
+    Whether array is a whole numpy.memmap of float32, whose filename and offset locate its data. Views of a memmap keep
+    the attributes of the original, so only an array whose buffer is the mapping itself qualifies.
+    """
+    return (isinstance(getattr(array, 'base', None), _mmap.mmap) and getattr(array, 'filename', None) is not None
+            and str(array.dtype) == 'float32')
+
+
+def span(distance_matrix, levels):
+    """
+    The quantization (scale, offset) mapping the range of the distances onto levels + 1 codes.
+    """
+    low, high = float(distance_matrix.min()), float(distance_matrix.max())
+    return ((high - low) / levels if high > low else 1.0), low
+
+
+def protoclust(distance_matrix, verbose=False, notebook=False, engine='all_pairs', n_threads=0, seed=None,
+               lazy=False, metric=False, layout='packed', mmap=None, dtype='float32', quantization=None,
+               feature_metric=None, store_distances=False, max_radius=None, min_clusters=None, thresholds=None):
     """
     An implementatin of representative hierarchical clustering using minimax linkage.
 
     Args:
         distance_matrix (:obj:`ndarray` of float): A distance matrix to be clustered.
-            Must be accessible with index pairs.
+            Either a square float64 matrix accessible with index pairs, or a contiguous float32/float64 condensed
+            distance vector as returned by scipy.spatial.distance.pdist (loaded without forming the square matrix).
+            With feature_metric, a C-contiguous float32 n by d array of feature vectors instead, or for the
+            'hamming' and 'tanimoto' metrics a C-contiguous array of n rows of bits (e.g. bool, or packed as by
+            numpy.packbits or into uint64 words).
         verbose (bool): Optional. Print a progress bar. Default False.
         notebook (bool): Optional. Flag if using a jupyter notebook to allow progress bar to print. Default False.
+        engine (str): Optional. How linkages are evaluated. 'all_pairs' rescans every pair of points in the merged
+            clusters; 'eccentricity' keeps the max distance from every point to each cluster so that a merge costs
+            O(n), at the cost of n floats per merged cluster awaiting a merge (up to n^2 / 2 floats, as much as the
+            distances themselves). Default 'all_pairs'.
+        n_threads (int): Optional. Threads for the distance updates after each merge, 0 for one per core.
+            Default 0.
+        seed (int): Optional. Seed for the random start of the nearest-neighbor chains. With a seed the result is
+            reproducible for a given distance matrix. Default None, seeded from the system.
+        lazy (bool): Optional. Link merged clusters to the other clusters only when a cheap lower bound shows that
+            the linkage could be a nearest neighbor. Runs on a single thread. Default False.
+        metric (bool): Optional. Declare that the distances satisfy the triangle inequality, so that lazy evaluation can
+            also bound linkages by the diameter of the union, at the cost of a second matrix. Default False.
+        layout (str): Optional. Storage of the point distances. 'packed' stores the rows of the lower triangle one after
+            the other; 'tiled' stores 32 by 32 tiles, so that the distances within a cluster share fewer pages;
+            'square' stores the full symmetric matrix (twice the memory), also for the distances between clusters,
+            so that every scan of the distances from one point or cluster is contiguous. Default 'packed'.
+        mmap (str or bool): Optional. Keep the distance matrices in temporary files mapped into memory rather than in
+            memory, so that only the pages in use need RAM: the directory for the files, or True for the default
+            temporary directory. A condensed float32 vector opened with numpy.load(..., mmap_mode='r') or
+            numpy.memmap is then mapped from its own file without loading (in the condensed order, whatever the
+            layout). Default None.
+        dtype (str): Optional. Storage type of the point distances: 'float32', 'float16' and 'bfloat16' round the
+            distances to the nearest value of the type, 'uint16' and 'uint8' quantize them to 2^16 or 2^8 levels (see
+            quantization). The narrow types take 2 to 4 times less memory; merges between distances that round to
+            the same value may then be ordered differently. Distances must be nonnegative. Default 'float32'.
+        quantization (tuple): Optional. (scale, offset) of the 'uint16' and 'uint8' types, which store
+            round((distance - offset) / scale). Default None, spanning the range of the distances.
+        feature_metric (str): Optional. Cluster the rows of distance_matrix, an array of feature vectors, under
+            'euclidean', 'cosine' or 'manhattan' distance. The distances between the points are computed as needed
+            rather than stored, so that only the distances between clusters take O(n^2) memory (half that of a
+            distance matrix, or a quarter with 'square'). 'hamming' (the number of differing bits) and 'tanimoto' (1 -
+            |a & b| / |a | b|) compare rows of bits with popcounts, packed 512 bits at a time. dtype must be
+            'float32' and 'metric' holds for every metric. Default None.
+        store_distances (bool): Optional. With a feature_metric of floats, compute every distance up front instead,
+            natively and in parallel blocks (Euclidean distances as |x|^2 + |y|^2 - 2 x.y, which loses digits between
+            points much closer together than their norms), and store them with the given layout and dtype. 'uint16'
+            and 'uint8' then need a quantization. Default False.
+        max_radius (float): Optional. Stop before merging clusters whose union has a larger minimax radius. Default
+            None.
+        min_clusters (int): Optional. Stop once this many clusters remain. Default None.
+            With either, only the merges of the full clustering up to the stop are made (exactly: those below the
+            radius, or the n - min_clusters lowest), which skips the largest and most expensive merges.
+        thresholds (sequence of float): Optional. Also cut the clustering at each of these heights, natively and in
+            parallel, as scipy.cluster.hierarchy.fcluster with criterion='distance' would one at a time. Default None.
 
     Returns:
         (tuple): tuple containing:
@@ -36,11 +116,69 @@ def protoclust(distance_matrix, verbose=False, notebook=False):
                 The prototypes associated with cluster at each linkage iteration.
                 The length of this list is equal to the size of the input data plus the length of Z.
 
+            With max_radius or min_clusters, Z holds only the merges made, followed by:
+
+            - :obj:`list`: labels
+                The cluster of each point among those that remain, numbered from 0 by their first point.
+
+            - :obj:`list`: cluster_prototypes
+                The prototype of each cluster that remains, by label.
+
+            With thresholds, Z and prototypes are followed by the cuts instead:
+
+            - labels
+                An n by len(thresholds) int32 buffer (e.g. for numpy.asarray) of the cluster of each point at each
+                threshold, numbered from 0 by first point.
+
+            - :obj:`list`: cluster_prototypes
+                For each threshold, the prototype of each cluster by label.
+
     """
-    n = len(distance_matrix)
-    p = CyProtoclust(n)
-    p.initialize_distances(distance_matrix)
-    for i in progress(range(n-1), verbose, notebook):
-        p.compute_at(i)
+    mmap_dir = tempfile.gettempdir() if mmap is True else (mmap or None)
+    if quantization is None and dtype in ('uint16', 'uint8') and len(distance_matrix) > 0:
+        if feature_metric is not None:
+            raise ValueError("Distances computed from features are not known in advance: give a quantization for "
+                             "dtype '{}'.".format(dtype))
+        quantization = span(distance_matrix, 2**16 - 1 if dtype == 'uint16' else 2**8 - 1)
+    options = (engine, n_threads, seed, lazy, metric, layout, mmap_dir, dtype, quantization)
+    stop = dict(max_radius=max_radius, min_clusters=min_clusters or 1)
+    if feature_metric in ('hamming', 'tanimoto'):
+        if store_distances:
+            raise ValueError("Distances between bits are computed as needed: store_distances is not supported for "
+                             "'{}'.".format(feature_metric))
+        # Only the counts of set bits matter, so any packing into bytes will do
+        n = len(distance_matrix)
+        p = CyProtoclust(n, *options, feature_metric=feature_metric, bits=distance_matrix.view('uint8'), **stop)
+    elif feature_metric is not None and store_distances:
+        n = len(distance_matrix)
+        p = CyProtoclust(n, *options, **stop)
+        p.initialize_features(distance_matrix, feature_metric)
+    elif feature_metric is not None:
+        n = len(distance_matrix)
+        p = CyProtoclust(n, *options, features=distance_matrix, feature_metric=feature_metric, **stop)
+    elif getattr(distance_matrix, 'ndim', 2) == 1:
+        n = condensed_size(len(distance_matrix))
+        if mmap_dir is not None and mapped_file(distance_matrix) and dtype == 'float32':
+            p = CyProtoclust(n, *options, mmap_file=distance_matrix.filename, mmap_offset=distance_matrix.offset,
+                             **stop)
+        else:
+            p = CyProtoclust(n, *options, **stop)
+            p.initialize_condensed(distance_matrix)
+    else:
+        n = len(distance_matrix)
+        p = CyProtoclust(n, *options, **stop)
+        p.initialize_distances(distance_matrix)
+    bar = progress(n-1, verbose, notebook)
+    if bar is None:
+        # Reports only check for interrupts
+        p.compute(interval=max(1, (n-1)//100))
+    else:
+        # Throttle bar updates to about a hundred per run
+        with bar:
+            p.compute(lambda merges: bar.update(merges - bar.n), max(1, (n-1)//100))
+    if thresholds is not None:
+        return (p.Z(n), p.cluster_centers(n)) + p.cut(n, thresholds)
+    if max_radius is not None or min_clusters is not None:
+        return p.Z(n), p.cluster_centers(n), p.labels(), p.prototypes()
     return p.Z(n), p.cluster_centers(n)
 
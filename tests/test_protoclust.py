@@ -1,5 +1,390 @@
-from protoclust import __version__
+import os
+import numpy as np
+import pytest
+from pyprotoclust import __version__, protoclust
+from pyprotoclust.c_protoclust import CyProtoclust, simd_isa, set_simd_isa
+
+# Opt-in for tests that need several GB of memory
+large = pytest.mark.skipif(not os.environ.get('PYPROTOCLUST_LARGE_TESTS'),
+                           reason='set PYPROTOCLUST_LARGE_TESTS to run large-memory tests')
+
+
+def random_distances(n, seed=0):
+    rng = np.random.RandomState(seed)
+    X = rng.normal(size=(n, 3))
+    return np.sqrt(((X[:, None, :] - X[None, :, :])**2).sum(axis=-1))
+
+
+def members(Z, n):
+    clusters = [[i] for i in range(n)]
+    for z in Z:
+        clusters.append(clusters[int(z[0])] + clusters[int(z[1])])
+    return clusters
 
 
 def test_version():
     assert __version__ == '0.1.0'
+
+
+def test_engines_agree():
+    n = 50
+    D = random_distances(n)
+    Z_all, P_all = protoclust(D, engine='all_pairs')
+    Z_ecc, P_ecc = protoclust(D, engine='eccentricity')
+    assert np.allclose(sorted(z[2] for z in Z_all), sorted(z[2] for z in Z_ecc))
+    # Each prototype is a member of its cluster whose radius is the linkage height
+    for Z, P in [(Z_all, P_all), (Z_ecc, P_ecc)]:
+        for z, c, p in zip(Z, members(Z, n)[n:], P[n:]):
+            assert p in c
+            assert np.isclose(D[p, c].max(), z[2])
+
+
+def test_simd_kernels_agree():
+    # Sizes that leave partial vectors at the end of each kernel
+    n = 77
+    D = random_distances(n)
+    native = simd_isa()
+    results = {}
+    try:
+        for isa in ['scalar', 'avx2', 'avx512']:
+            try:
+                set_simd_isa(isa)
+            except ValueError:
+                continue
+            for engine in ['all_pairs', 'eccentricity']:
+                Z, P = protoclust(D, engine=engine)
+                results[isa, engine] = sorted(z[2] for z in Z)
+    finally:
+        set_simd_isa(native)
+    expected = results['scalar', 'all_pairs']
+    for heights in results.values():
+        assert np.allclose(heights, expected)
+
+
+def test_threads_agree():
+    # Large enough for the late all-pairs updates to pass the serial cutoff. The chain starts at a
+    # random cluster, so compare each merge with its minimax radius rather than across runs.
+    n = 400
+    D = random_distances(n)
+    for engine in ['all_pairs', 'eccentricity']:
+        Z, P = protoclust(D, engine=engine, n_threads=4)
+        for z, c, p in zip(Z, members(Z, n)[n:], P[n:]):
+            assert p in c
+            assert np.isclose(D[np.ix_(c, c)].max(axis=1).min(), z[2])
+            assert np.isclose(D[p, c].max(), z[2])
+
+
+def test_threads_raise():
+    # An exception on any thread reaches the caller once the loop is done: distances computed from
+    # features cannot be stored
+    n = 300
+    X = np.random.RandomState(14).normal(size=(n, 8)).astype(np.float32)
+    for n_threads in [1, 3]:
+        p = CyProtoclust(n, n_threads=n_threads, features=X)
+        with pytest.raises(RuntimeError):
+            p.initialize_features(X)
+
+
+def test_computed_distances_are_read_only():
+    n = 5
+    X = np.zeros((n, 3), dtype=np.float32)
+    bits = np.zeros((n, 2), dtype=np.uint8)
+    for p in [CyProtoclust(n, features=X), CyProtoclust(n, feature_metric='hamming', bits=bits)]:
+        with pytest.raises(RuntimeError):
+            p.initialize_distances(np.zeros((n, n)))
+        with pytest.raises(RuntimeError):
+            p.initialize_condensed(np.zeros(n * (n - 1) // 2))
+
+
+def test_seed_reproducible():
+    # Quantized distances have many ties, which must be broken the same way in every run
+    n = 200
+    D = np.round(random_distances(n), 1)
+    for engine in ['all_pairs', 'eccentricity']:
+        Z, P = protoclust(D, engine=engine, seed=7)
+        for threads in [1, 4]:
+            Zs, Ps = protoclust(D, engine=engine, n_threads=threads, seed=7)
+            assert np.array_equal(Z, Zs)
+            assert np.array_equal(P, Ps)
+
+
+def test_chain_ties():
+    # Mostly equal distances: chains still end at recurrent pairs after a few steps per merge
+    n = 300
+    D = np.round(random_distances(n))
+    p = CyProtoclust(n, seed=0)
+    p.initialize_distances(D)
+    p.compute()
+    assert p.chain_steps() < 4 * (n - 1)
+    Z = p.Z(n)
+    for z, c in zip(Z, members(Z, n)[n:]):
+        assert np.isclose(D[np.ix_(c, c)].max(axis=1).min(), z[2])
+
+
+def test_lazy_evaluation():
+    # Bounds only skip linkages that cannot be nearest neighbors, so the tree is unchanged
+    n = 300
+    D = random_distances(n)
+    for engine in ['all_pairs', 'eccentricity']:
+        runs, evaluations = [], []
+        for lazy, metric in [(False, False), (True, False), (True, True)]:
+            p = CyProtoclust(n, engine, seed=3, lazy=lazy, metric=metric)
+            p.initialize_distances(D)
+            p.compute()
+            runs.append((p.Z(n), p.cluster_centers(n)))
+            evaluations.append(p.lazy_evaluations())
+        assert runs[0] == runs[1] == runs[2]
+        assert evaluations[2] <= evaluations[1] < n * (n - 1) // 8
+
+    # Tied metric distances (the radius of a union is only bounded by its diameter, not its complete linkage)
+    X = np.random.default_rng(5).integers(0, 2, size=(n, 6))
+    D = np.abs(X[:, None, :] - X[None, :, :]).sum(-1).astype(float)
+    runs = []
+    for lazy in [False, True]:
+        p = CyProtoclust(n, 'all_pairs', seed=3, lazy=lazy, metric=lazy)
+        p.initialize_distances(D)
+        p.compute()
+        runs.append((p.Z(n), p.cluster_centers(n)))
+    assert runs[0] == runs[1]
+
+
+def test_tiled_layout():
+    # Sizes that leave partial tiles, including a single point in the last tile row. Rounded distances tie, and
+    # ties resolve as in the packed triangle: the same tree and prototypes
+    for n in [40, 65]:
+        for D in [random_distances(n), np.round(random_distances(n) * 4)]:
+            for engine in ['all_pairs', 'eccentricity']:
+                Z, P = protoclust(D, engine=engine, seed=1)
+                Zt, Pt = protoclust(D, engine=engine, seed=1, layout='tiled')
+                assert np.array_equal(np.asarray(Z), np.asarray(Zt))
+                assert np.array_equal(P, Pt)
+
+
+def test_square_layout():
+    # Same slot distances read row by row: the same tree as the packed triangle
+    n = 70
+    D = random_distances(n)
+    for engine in ['all_pairs', 'eccentricity']:
+        for lazy in [False, True]:
+            Z, P = protoclust(D, engine=engine, seed=2, lazy=lazy, metric=lazy)
+            Zs, Ps = protoclust(D, engine=engine, seed=2, lazy=lazy, metric=lazy, layout='square')
+            assert np.array_equal(np.asarray(Z), np.asarray(Zs))
+            assert np.array_equal(P, Ps)
+
+
+def test_mmap(tmp_path):
+    # Temporary mapped matrices, and a condensed file mapped in place (at a nonzero offset)
+    n = 50
+    D = random_distances(n)
+    condensed = D[np.triu_indices(n, 1)].astype(np.float32)
+    np.save(tmp_path / 'condensed.npy', condensed)
+    mapped = np.load(tmp_path / 'condensed.npy', mmap_mode='r')
+    for engine in ['all_pairs', 'eccentricity']:
+        Z, P = protoclust(condensed, engine=engine, seed=4, lazy=True, metric=True)
+        for D_in in [condensed, mapped]:
+            Zm, Pm = protoclust(D_in, engine=engine, seed=4, lazy=True, metric=True, mmap=str(tmp_path))
+            assert np.array_equal(np.asarray(Z), np.asarray(Zm))
+            assert np.array_equal(P, Pm)
+    assert os.listdir(tmp_path) == ['condensed.npy']
+    # The file is mapped read-only
+    p = CyProtoclust(n, mmap_dir=str(tmp_path), mmap_file=mapped.filename, mmap_offset=mapped.offset)
+    with pytest.raises(RuntimeError):
+        p.initialize_condensed(condensed)
+    with pytest.raises(RuntimeError):
+        p.initialize_distances(D)
+    assert np.array_equal(np.load(tmp_path / 'condensed.npy'), condensed)
+
+
+def test_narrow_distances():
+    # Whole distances up to 200 are exact in every type: the same tree as float32
+    n = 60
+    D = np.round(random_distances(n) * 50)
+    for engine in ['all_pairs', 'eccentricity']:
+        Z, P = protoclust(D, engine=engine, seed=5)
+        for dtype in ['float16', 'bfloat16', 'uint16', 'uint8']:
+            Zq, Pq = protoclust(D, engine=engine, seed=5, dtype=dtype, quantization=(1.0, 0.0))
+            assert np.array_equal(np.asarray(Z), np.asarray(Zq))
+            assert np.array_equal(P, Pq)
+    # Otherwise each height is the decoded radius, within one step of the exact one
+    D = random_distances(n)
+    Zq, Pq = protoclust(D, seed=5, dtype='uint8')
+    for z, c, p in zip(Zq, members(Zq, n)[n:], Pq[n:]):
+        assert abs(D[p, c].max() - z[2]) <= D.max() / 255
+
+
+def test_feature_distances():
+    # Manhattan distances of whole features are exact: the same tree as the distance matrix
+    n = 60
+    X = np.random.RandomState(6).randint(-20, 20, size=(n, 19)).astype(np.float32)
+    D = np.abs(X[:, None, :] - X[None, :, :]).sum(axis=-1).astype(np.float64)
+    for engine, lazy in [('all_pairs', False), ('eccentricity', False), ('all_pairs', True)]:
+        Z, P = protoclust(D, engine=engine, seed=6, lazy=lazy, metric=lazy)
+        Zf, Pf = protoclust(X, engine=engine, seed=6, lazy=lazy, metric=lazy, feature_metric='manhattan')
+        assert np.array_equal(np.asarray(Z), np.asarray(Zf))
+        assert np.array_equal(P, Pf)
+    # Otherwise each height is the radius of its prototype, up to rounding
+    X = np.random.RandomState(7).normal(size=(n, 37)).astype(np.float32)
+    unit = X / np.linalg.norm(X, axis=1, keepdims=True)
+    distances = {'euclidean': np.sqrt(((X[:, None, :] - X[None, :, :])**2).sum(axis=-1)),
+                 'cosine': 1 - unit @ unit.T}
+    for feature_metric, D in distances.items():
+        Zf, Pf = protoclust(X, feature_metric=feature_metric, layout='square')
+        for z, c, p in zip(Zf, members(Zf, n)[n:], Pf[n:]):
+            assert p in c
+            assert np.isclose(D[p, c].max(), z[2], atol=1e-5)
+
+
+def test_stored_feature_distances():
+    # Built natively in tiles (n spans several): exact for Manhattan distances of whole features
+    n = 150
+    X = np.random.RandomState(8).randint(-20, 20, size=(n, 7)).astype(np.float32)
+    D = np.abs(X[:, None, :] - X[None, :, :]).sum(axis=-1).astype(np.float64)
+    Z, P = protoclust(D, seed=8)
+    for layout in ['packed', 'tiled', 'square']:
+        Zf, Pf = protoclust(X, seed=8, layout=layout, feature_metric='manhattan', store_distances=True)
+        assert np.array_equal(np.asarray(Z), np.asarray(Zf))
+        assert np.array_equal(P, Pf)
+    # The Gram form of Euclidean distances agrees up to rounding
+    X = np.random.RandomState(9).normal(size=(n, 21)).astype(np.float32)
+    D = np.sqrt(((X[:, None, :] - X[None, :, :])**2).sum(axis=-1))
+    Zf, Pf = protoclust(X, feature_metric='euclidean', store_distances=True, n_threads=3)
+    for z, c, p in zip(Zf, members(Zf, n)[n:], Pf[n:]):
+        assert p in c
+        assert np.isclose(D[p, c].max(), z[2], atol=1e-4)
+
+
+def test_bit_distances():
+    # Counts are exact: the same tree as the distance matrix, from bools or packed bits
+    n = 70
+    B = np.random.RandomState(10).rand(n, 300) < 0.3
+    shared = (B[:, None, :] & B[None, :, :]).sum(axis=-1)
+    either = (B[:, None, :] | B[None, :, :]).sum(axis=-1)
+    distances = {'hamming': (B[:, None, :] != B[None, :, :]).sum(axis=-1).astype(np.float64),
+                 'tanimoto': (1 - shared.astype(np.float32) / either.astype(np.float32)).astype(np.float64)}
+    for feature_metric, D in distances.items():
+        for engine in ['all_pairs', 'eccentricity']:
+            Z, P = protoclust(D, engine=engine, seed=10)
+            for bits in [B, np.packbits(B, axis=1)]:
+                Zb, Pb = protoclust(bits, engine=engine, seed=10, feature_metric=feature_metric)
+                assert np.array_equal(np.asarray(Z), np.asarray(Zb))
+                assert np.array_equal(P, Pb)
+
+
+def test_early_stop():
+    # The clusters left are those of the full clustering cut at the radius, or at the count
+    n = 80
+    D = random_distances(n, seed=11)
+    for engine, lazy in [('all_pairs', False), ('eccentricity', False), ('eccentricity', True)]:
+        Z, P = protoclust(D, engine=engine, lazy=lazy)
+        heights = sorted(z[2] for z in Z)
+        for stop, merges in [(dict(max_radius=heights[50]), 51), (dict(min_clusters=7), n - 7),
+                             (dict(max_radius=heights[70], min_clusters=20), n - 20)]:
+            Zs, Ps, labels, prototypes = protoclust(D, engine=engine, lazy=lazy, **stop)
+            assert len(Zs) == merges and len(Ps) == n + merges
+            assert np.array_equal(sorted(z[2] for z in Zs), heights[:merges])
+            # Each merge of the full clustering below the stop is made, with a prototype as central
+            full = {frozenset(c): p for c, p in zip(members(Z, n), P)}
+            for c, p in zip(members(Zs, n), Ps):
+                assert p in c
+                assert D[p, c].max() == D[full[frozenset(c)], c].max()
+            clusters = members(Zs, n)
+            roots = set(range(n + merges)) - {int(c) for z in Zs for c in z[:2]}
+            assert len(prototypes) == len(roots) == n - merges
+            for r in roots:
+                label = labels[clusters[r][0]]
+                assert [labels[i] for i in clusters[r]] == [label] * len(clusters[r])
+                assert prototypes[label] == Ps[r]
+
+
+def test_threshold_cuts():
+    # Each cut holds the clusters made by the merges up to its height, labelled by first point
+    n = 80
+    D = random_distances(n, seed=12)
+    thresholds = np.linspace(-0.1, 4, 120)
+    Z, P, labels, prototypes = protoclust(D, n_threads=3, thresholds=thresholds)
+    labels = np.asarray(labels)
+    assert labels.shape == (n, len(thresholds))
+    clusters = members(Z, n)
+    for t, threshold in enumerate(thresholds):
+        within = {int(c) for z in Z if z[2] <= threshold for c in z[:2]}
+        roots = [r for r in range(len(clusters)) if r not in within and (r < n or Z[r - n][2] <= threshold)]
+        roots.sort(key=lambda r: min(clusters[r]))
+        assert prototypes[t] == [P[r] for r in roots]
+        for label, r in enumerate(roots):
+            assert np.all(labels[clusters[r], t] == label)
+
+
+def test_condensed_input():
+    n = 30
+    D = random_distances(n)
+    condensed = D[np.triu_indices(n, 1)]
+    Z, P = protoclust(D)
+    for dtype in [np.float64, np.float32]:
+        Zc, Pc = protoclust(condensed.astype(dtype))
+        assert np.allclose(sorted(z[2] for z in Z), sorted(z[2] for z in Zc))
+
+
+def test_batched_rounds():
+    # Rounds merge every recurrent pair found, far fewer rounds than merges, in ties as well
+    n = 1000
+    D = random_distances(n, seed=13)
+    heights = []
+    for distances, merges in [(np.round(D, 1), None), (D, None), (D, 1)]:
+        p = CyProtoclust(n, seed=13)
+        p.initialize_distances(distances)
+        if merges is None:
+            p.compute(interval=n)
+        else:
+            for i in range(n - 1):
+                p.compute_at(i)
+        assert p.rounds() < n // 10 if merges is None else p.rounds() == n - 1
+        heights.append(sorted(z[2] for z in p.Z(n)))
+    # One merge per round makes the same merges
+    assert np.allclose(heights[1], heights[2])
+    # Reports do not cut rounds short: each multiple of the interval is still reported
+    p = CyProtoclust(n, seed=13)
+    p.initialize_distances(D)
+    reports = []
+    p.compute(reports.append, 1)
+    assert p.rounds() < n // 10
+    assert reports == list(range(1, n))
+
+
+def test_compute_progress():
+    n = 40
+    p = CyProtoclust(n)
+    p.initialize_distances(random_distances(n))
+    reports = []
+    p.compute(reports.append, 10)
+    assert reports == [10, 20, 30, n - 1]
+    # By default about a hundred reports, or none without a callback
+    for callback, expected in [(reports.append, list(range(1, n))), (None, [])]:
+        p = CyProtoclust(n)
+        p.initialize_distances(random_distances(n))
+        reports.clear()
+        p.compute(callback)
+        assert reports == expected and len(p.Z(n)) == n - 1
+
+    # An exception from the callback stops the clustering and is raised from compute
+    def stop(merges):
+        raise KeyboardInterrupt
+    p = CyProtoclust(n)
+    p.initialize_distances(random_distances(n))
+    with pytest.raises(KeyboardInterrupt):
+        p.compute(stop, 10)
+
+
+@large
+def test_past_int_offset_boundary():
+    # Packed triangle offsets pass INT_MAX once n > 46341. Needs about 13 GB: the condensed float32
+    # vector (built row by row, without a square matrix), its copy and the distances between clusters.
+    n = 46400
+    x = np.sort(np.random.RandomState(0).uniform(size=n))
+    D = np.empty(n * (n - 1) // 2, dtype=np.float32)
+    k = 0
+    for i in range(n - 1):
+        D[k:k + n - 1 - i] = x[i + 1:] - x[i]
+        k += n - 1 - i
+    Z, P = protoclust(D)
+    assert len(Z) == n - 1 and Z[-1][3] == n
+    assert np.isclose(Z[-1][2], max(x[-1] - x[P[-1]], x[P[-1]] - x[0]))